@@ -1,60 +1,367 @@
 #include "emJSON.h"
 #include "json_internal.h"
 #include <string.h>
+#ifdef EMJSON_HAS_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * Each object buffer is preceded by the allocator it came from, so that it
+ * is grown and freed with the same one.
+ */
+union block_
+{
+    const emJSON_allocator_t *allocator;
+    long double align_;		// keep the buffer aligned
+};
+
+#define block_ptr_(obj)     ((union block_ *)(obj)->buf - 1)
+#define allocator_(obj)     (block_ptr_(obj)->allocator)
+
+static json_t init_sized_(const emJSON_allocator_t *allocator, size_t size, size_t table_size);
+static int parse_with_(json_t *obj, char *input, char *stop, int borrow);
+static int make_room_(json_t *obj, int ret);
+static int grow_buffer_(json_t *obj, size_t increment);
+static int is_block_(json_t *obj);
+static const emJSON_allocator_t *owner_allocator_(json_t *obj);
+static void free_links_(json_t *obj);
+static void free_block_(json_t *obj);
+#ifdef JSON_HAS_ATOMIC
+static int concurrent_grow_(json_t *obj);
+#endif
+static size_t pool_class_(size_t size);
+static void *pooled_alloc_(void *ctx, size_t size);
+static void *pooled_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size);
+static void *libc_alloc_(void *ctx, size_t size);
+static void *libc_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size);
+static void libc_free_(void *ctx, void *ptr, size_t size);
+
+static const emJSON_allocator_t libc_allocator_ = {
+    .alloc = libc_alloc_,
+    .realloc = libc_realloc_,
+    .free = libc_free_,
+    .ctx = NULL
+};
+static const emJSON_allocator_t *default_allocator_ = &libc_allocator_;
+
+#ifdef EMJSON_HAS_THREADS
+// A range of the input of emJSON_parse_parallel(), in a thread of its own.
+struct part_
+{
+    char *begin;		// of a slice to scan, then of the part to parse
+    char *end;			// of the slice, then the stop of the part
+    struct scan_ scan;
+    json_t obj;			// the part, parsed
+    json_t *dest;		// the object the parts are joined into
+    size_t offset;		// of the content of the part in dest
+    int status;
+};
+
+static void run_parts_(struct part_ *part, size_t count, void *(*fn)(void *));
+static void *scan_slice_(void *arg);
+static void *parse_part_(void *arg);
+static void *copy_part_(void *arg);
+static int join_parts_(json_t *obj, struct part_ *part, size_t count);
+#endif
+
+/*
+ * Pooled objects. Released buffers are kept cleared in lists of their size
+ * class, one set for each thread. Class n holds blocks of
+ * EMJSON_POOL_MIN_SIZE << n bytes.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+    #define THREAD_LOCAL_   __thread
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+    #define THREAD_LOCAL_   _Thread_local
+#else
+    #define THREAD_LOCAL_	// single thread
+#endif
+
+struct pool_
+{
+    union block_ *list[EMJSON_POOL_CLASSES];	// linked through the allocator field
+    uint8_t count[EMJSON_POOL_CLASSES];
+    size_t typical_size;	// moving average of the sizes released
+    size_t typical_table;
+    emJSON_pooled_stats_t stats;
+};
+
+static THREAD_LOCAL_ struct pool_ pool_;
+
+#define pool_block_size_(class)     ((size_t)EMJSON_POOL_MIN_SIZE << (class))
+
+// Blocks are given in whole classes, so growing stays in place for a while.
+static const emJSON_allocator_t pooled_allocator_ = {
+    .alloc = pooled_alloc_,
+    .realloc = pooled_realloc_,
+    .free = libc_free_,
+    .ctx = NULL
+};
+
+/*******************************************************************************
+ * Allocator functions
+ ******************************************************************************/
+
+// Set the allocator of objects from emJSON_init(). NULL is malloc() and free().
+void emJSON_set_allocator(const emJSON_allocator_t *allocator)
+{
+    default_allocator_ = (NULL != allocator) ? allocator : &libc_allocator_;
+}
+
+/*******************************************************************************
+ * high-level functions
+ ******************************************************************************/
 
 json_t emJSON_init()
 {
-    void *buffer = malloc(EMJSON_INIT_BUF_SIZE);
-    json_t result = json_init(buffer, EMJSON_INIT_BUF_SIZE, EMJSON_INIT_TABLE_SIZE);
-    return result;
+    return emJSON_init_with(default_allocator_);
 }
 
-int emJSON_parse(json_t *obj, char *input)
+// The allocator must live as long as the object.
+json_t emJSON_init_with(const emJSON_allocator_t *allocator)
 {
-    int ret;
-    ret = json_parse(obj, input);
-    
-    while (ret != JSON_OK)
-    {
-        void *new_buf;
-        void *old_buf;
-        int buf_size = json_buffer_size(obj);
-        
-        switch (ret)
+    return init_sized_(allocator, EMJSON_INIT_BUF_SIZE, EMJSON_INIT_TABLE_SIZE);
+}
+
+/*******************************************************************************
+ * Pooled objects
+ ******************************************************************************/
+
+/*
+ * Like emJSON_init(), but the buffer is taken from the pool of this thread,
+ * sized for what has been released so far. Give it back by emJSON_release().
+ */
+json_t emJSON_init_pooled(void)
+{
+    size_t size = (pool_.typical_size > EMJSON_INIT_BUF_SIZE) ?
+            pool_.typical_size : EMJSON_INIT_BUF_SIZE;
+    size_t class = pool_class_(sizeof(union block_) + size);
+    if (class < EMJSON_POOL_CLASSES)
+    {   // a bigger one will do as well
+        for (size_t i = class; i < EMJSON_POOL_CLASSES; i++)
         {
-        case JSON_KEY_EXISTS:
-            return JSON_KEY_EXISTS;
-        case JSON_TABLE_FULL:
-            json_clear(obj);
-            ret = json_double_table(obj);
-            if (JSON_OK == ret)
+            union block_ *block = pool_.list[i];
+            if (NULL != block)
             {
-                ret = json_parse(obj, input);
+                pool_.list[i] = (union block_ *)block->allocator;
+                pool_.count[i] -= 1;
+                pool_.stats.hits += 1;
+                block->allocator = &pooled_allocator_;
+                return (json_t){ .buf = block + 1 };
             }
-            break;
-        case JSON_BUFFER_FULL:
-            old_buf = obj->buf;
-            buf_size += 32;
-            new_buf = malloc(buf_size);
-            json_replace_buffer(obj, new_buf, buf_size);
-            free(old_buf);
-            json_clear(obj);
-            ret = json_parse(obj, input);
-            break;
-        default:
-            return JSON_ERROR;
         }
+        size = pool_block_size_(class) - sizeof(union block_);
+    }
+    pool_.stats.misses += 1;
+    union block_ *block = pooled_alloc_(NULL, sizeof(union block_) + size);
+    if (NULL == block)
+    {
+        return (json_t){0};
+    }
+    block->allocator = &pooled_allocator_;
+    size_t table_size = (pool_.typical_table > EMJSON_INIT_TABLE_SIZE) ?
+            pool_.typical_table : EMJSON_INIT_TABLE_SIZE;
+    json_t obj = json_init(block + 1, size, table_size);
+    if (NULL == obj.buf)
+    {
+        free(block);
+    }
+    return obj;
+}
+
+/*
+ * Give an object back to the pool of this thread, cleared. Objects not from
+ * emJSON_init_pooled() are freed.
+ */
+int emJSON_release(json_t *obj)
+{
+    if (&pooled_allocator_ != allocator_(obj) || json_is_frozen(obj))
+    {
+        return emJSON_free(obj);
+    }
+    // learn, weighing the last one by 1/4
+    size_t size = json_buffer_size(obj);
+    size_t table_size = json_table_size(obj);
+    pool_.typical_size = (0 == pool_.typical_size) ? size :
+            pool_.typical_size - pool_.typical_size / 4 + size / 4;
+    if (table_size > pool_.typical_table)
+    {
+        pool_.typical_table = table_size;
+    }
+
+    size_t class = pool_class_(sizeof(union block_) + size);
+    if (class >= EMJSON_POOL_CLASSES || pool_.count[class] >= EMJSON_POOL_DEPTH)
+    {
+        return emJSON_free(obj);
+    }
+    free_links_(obj);
+    json_clear(obj);
+    union block_ *block = block_ptr_(obj);
+    block->allocator = (const emJSON_allocator_t *)pool_.list[class];
+    pool_.list[class] = block;
+    pool_.count[class] += 1;
+    obj->buf = NULL;
+    return 0;
+}
+
+// Hits and misses of emJSON_init_pooled() and buffers kept, in this thread.
+void emJSON_pooled_stats(emJSON_pooled_stats_t *stats)
+{
+    *stats = pool_.stats;
+    stats->cached = 0;
+    for (size_t i = 0; i < EMJSON_POOL_CLASSES; i++)
+    {
+        stats->cached += pool_.count[i];
     }
-    return JSON_OK;
 }
 
+// Free the buffers kept for this thread, as before the thread ends.
+void emJSON_pooled_drain(void)
+{
+    for (size_t i = 0; i < EMJSON_POOL_CLASSES; i++)
+    {
+        while (NULL != pool_.list[i])
+        {
+            union block_ *block = pool_.list[i];
+            pool_.list[i] = (union block_ *)block->allocator;
+            free(block);
+        }
+        pool_.count[i] = 0;
+    }
+}
+
+/*******************************************************************************
+ * Parsing and deletion
+ ******************************************************************************/
+
+int emJSON_parse(json_t *obj, char *input)
+{
+    return parse_with_(obj, input, NULL, 0);
+}
+
+// See json_parse_borrowed(). input must live as long as obj.
+int emJSON_parse_borrowed(json_t *obj, char *input)
+{
+    return parse_with_(obj, input, NULL, 1);
+}
+
+#ifdef EMJSON_HAS_THREADS
+/*
+ * Like emJSON_parse(), in up to thread_count threads. The members of the
+ * object are parsed in parts, each into a buffer of its own, which are then
+ * joined into obj. For a big object into an empty one; others, and input
+ * with anything after the object, are parsed by emJSON_parse().
+ */
+int emJSON_parse_parallel(json_t *obj, char *input, int thread_count)
+{
+    if (json_is_frozen(obj))
+    {
+        return JSON_FROZEN;
+    }
+    size_t len = strlen(input);
+    char *open;
+    char *close;
+    if (len < EMJSON_PARALLEL_MIN_SIZE || json_count(obj) > 0 ||
+        JSON_OK != outer_braces_(input, len, &open, &close))
+    {
+        return emJSON_parse(obj, input);
+    }
+    size_t count = (thread_count < 1) ? 1 : (size_t)thread_count;
+    count = (count > EMJSON_PARALLEL_MAX_THREADS) ? EMJSON_PARALLEL_MAX_THREADS : count;
+    struct part_ part[EMJSON_PARALLEL_MAX_THREADS];
+
+    // Scan slices of the same length at once, for quotes and braces.
+    for (size_t k = 0; k < count; k++)
+    {
+        part[k] = (struct part_){
+            .begin = open + (close - open) * k / count,
+            .end = open + (close - open) * (k + 1) / count
+        };
+    }
+    run_parts_(part, count, scan_slice_);
+
+    // Then whether each slice starts in a string and at which depth is
+    // known, and it is split at the first member in it. From the last one,
+    // so that a scan ends at the next slice, as the member found there is
+    // the same. The last part ends at the closing brace.
+    int in_string[EMJSON_PARALLEL_MAX_THREADS];
+    long depth[EMJSON_PARALLEL_MAX_THREADS];
+    char *split[EMJSON_PARALLEL_MAX_THREADS + 1];
+    in_string[0] = 0;
+    depth[0] = 0;
+    for (size_t k = 1; k < count; k++)
+    {
+        in_string[k] = in_string[k - 1] ^ (part[k - 1].scan.quotes & 1);
+        depth[k] = depth[k - 1] + part[k - 1].scan.depth[in_string[k - 1]];
+    }
+    split[0] = open;
+    split[count] = close;
+    for (size_t k = count - 1; k > 0; k--)
+    {
+        char *member = find_member_(part[k].begin, part[k].end, in_string[k], depth[k]);
+        split[k] = (NULL != member) ? member : split[k + 1];
+    }
+
+    // Parse the members between the splits.
+    size_t parts = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        if (split[k] != split[k + 1])
+        {
+            part[parts++] = (struct part_){
+                .begin = split[k],
+                .end = split[k + 1]
+            };
+        }
+    }
+    run_parts_(part, parts, parse_part_);
+    int ret = JSON_OK;
+    for (size_t k = 0; k < parts && JSON_OK == ret; k++)
+    {
+        ret = part[k].status;
+    }
+    if (JSON_OK == ret)
+    {
+        ret = join_parts_(obj, part, parts);
+    }
+    // parsed children are in the buffers of the parts, so nothing is linked
+    for (size_t k = 0; k < parts; k++)
+    {
+        if (NULL != part[k].obj.buf)
+        {
+            free_block_(&part[k].obj);
+        }
+    }
+    // Bad input is left to emJSON_parse(), so that the result is the same.
+    return (JSON_ERROR == ret) ? emJSON_parse(obj, input) : ret;
+}
+#endif
+
 int emJSON_delete(json_t *obj, char *key)
 {
+    if (json_is_frozen(obj))
+    {
+        return JSON_FROZEN;
+    }
+    json_t child = json_get_obj(obj, key);
+    if (NULL != child.buf)
+    {   // free the buffers of its own before it is gone
+        free_links_(&child);
+        if (is_block_(&child))
+        {
+            free_block_(&child);
+        }
+    }
     return json_delete(obj, key);
 }
 
 int emJSON_clear(json_t *obj)
 {
+    if (json_is_frozen(obj))
+    {
+        return JSON_FROZEN;
+    }
+    free_links_(obj);
     return json_clear(obj);
 }
 
@@ -68,36 +375,42 @@ int emJSON_insert(json_t *obj, char *key, void *value, json_type_t type)
     ret = json_insert(obj, key, value, type);
     while (ret != JSON_OK)
     {
-        void *new_buf;
-        void *old_buf;
-        int buf_size = json_buffer_size(obj);
-        
-        switch (ret)
+        ret = make_room_(obj, ret);
+        if (JSON_OK != ret)
         {
-        case JSON_KEY_EXISTS:
-            return JSON_KEY_EXISTS;
-        case JSON_TABLE_FULL:
-            ret = json_double_table(obj);
-            if (JSON_OK == ret)
-            {
-                ret = json_insert(obj, key, value, type);
-            }
-            break;
-        case JSON_BUFFER_FULL:
-            old_buf = obj->buf;
-            buf_size += 32;
-            new_buf = malloc(buf_size);
-            json_replace_buffer(obj, new_buf, buf_size);
-            free(old_buf);
-            ret = json_insert(obj, key, value, type);
-            break;
-        default:
-            return JSON_ERROR;
+            return ret;
         }
+        ret = json_insert(obj, key, value, type);
     }
     return JSON_OK;
 }
 
+/*
+ * Insert an empty object with a buffer of its own, from the allocator of
+ * obj, and return it. It grows by itself, without moving obj.
+ */
+json_t emJSON_insert_empty_obj(json_t *obj, char *key)
+{
+    json_t child = emJSON_init_with(owner_allocator_(obj));
+    if (NULL == child.buf)
+    {
+        return child;
+    }
+    int ret;
+    ret = json_link_obj(obj, key, &child);
+    while (ret != JSON_OK)
+    {
+        ret = make_room_(obj, ret);
+        if (JSON_OK != ret)
+        {
+            free_block_(&child);
+            return (json_t){0};
+        }
+        ret = json_link_obj(obj, key, &child);
+    }
+    return child;
+}
+
 int emJSON_insert_str(json_t *obj, char *key, char *value)
 {
     return emJSON_insert(obj, key, value, JSON_STRING);
@@ -113,6 +426,41 @@ int emJSON_insert_float(json_t *obj, char *key, float value)
     return emJSON_insert(obj, key, &value, JSON_FLOAT);
 }
 
+/*
+ * Insert n members at once. If they do not fit, the table is sized for all
+ * of them and the buffer grown in one step, instead of on each insertion.
+ */
+int emJSON_insert_batch(json_t *obj, const json_member_t *items, size_t n)
+{
+    int ret = json_insert_batch(obj, items, n);
+    if (JSON_TABLE_FULL != ret && JSON_BUFFER_FULL != ret)
+    {
+        return ret;
+    }
+    size_t bytes;
+    batch_bytes_(items, n, &bytes);
+    size_t table_size = table_size_(obj);
+    while (table_size < entry_count_(obj) + n)
+    {
+        table_size <<= 1;
+    }
+    size_t required = buf_idx_(obj) + bytes + (table_size - table_size_(obj)) * sizeof(struct entry_);
+    if (required > json_buffer_size(obj) &&
+        JSON_OK != grow_buffer_(obj, required - json_buffer_size(obj)))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    if (table_size > table_size_(obj))
+    {
+        ret = resize_table_(obj, table_size);
+        if (JSON_OK != ret)
+        {
+            return ret;
+        }
+    }
+    return json_insert_batch(obj, items, n);
+}
+
 /*******************************************************************************
  * Getter functions
  ******************************************************************************/
@@ -150,10 +498,14 @@ int emJSON_set_str(json_t *obj, char *key, char *value)
 {
     int ret;
     ret = json_set_str(obj, key, value);
-    if (ret == JSON_ENTRY_BUFFER_FULL)
+    while (ret == JSON_BUFFER_FULL)
     {
-        emJSON_delete(obj, key);
-        ret = emJSON_insert_str(obj, key, value);
+        // Grow by half so that appending new slots stays amortized O(1).
+        if (JSON_OK != grow_buffer_(obj, json_buffer_size(obj) / 2 + strlen(value) + 1))
+        {
+            return JSON_BUFFER_FULL;
+        }
+        ret = json_set_str(obj, key, value);
     }
     return ret;
 }
@@ -168,30 +520,477 @@ int emJSON_set_float(json_t *obj, char *key, float value)
     return json_set_float(obj, key, value);
 }
 
+int emJSON_add_int(json_t *obj, char *key, int value)
+{
+    return json_add_int(obj, key, value);
+}
+
+int emJSON_add_float(json_t *obj, char *key, float value)
+{
+    return json_add_float(obj, key, value);
+}
+
+int emJSON_increment(json_t *obj, char *key)
+{
+    return json_increment(obj, key);
+}
+
 /*******************************************************************************
  * String-related functions
  ******************************************************************************/
 
+/*
+ * The string is from the default allocator, as obj may be from json_init().
+ * Release it with emJSON_free_str(), or free() if that is malloc().
+ */
 char *emJSON_string(json_t *obj)
 {
-    int len = json_strlen(obj) + 1;
-    char *str = malloc(len * sizeof(char));
-    json_strcpy(str, obj);
+    // The length is known, so it is allocated once.
+    size_t size = json_strlen(obj) + 1;
+    const emJSON_allocator_t *allocator = default_allocator_;
+    char *str = allocator->alloc(allocator->ctx, size);
+    if (NULL == str)
+    {
+        return NULL;
+    }
+    if (json_strncpy(str, obj, size) < 0)
+    {
+        allocator->free(allocator->ctx, str, size);
+        return NULL;
+    }
     return str;
 }
 
+int emJSON_free_str(char *str)
+{
+    const emJSON_allocator_t *allocator = default_allocator_;
+    allocator->free(allocator->ctx, str, strlen(str) + 1);
+    return 0;
+}
+
 int emJSON_strcpy(char *dest, json_t *obj)
 {
     return json_strcpy(dest, obj);
 }
 
+/*
+ * A copy of obj in a block of exactly its size, from the same allocator.
+ * Nested objects are packed into it. Free it by emJSON_free().
+ */
+json_t emJSON_clone(json_t *obj)
+{
+    const emJSON_allocator_t *allocator = owner_allocator_(obj);
+    size_t size = json_compact_size(obj);
+    union block_ *block = allocator->alloc(allocator->ctx, sizeof(union block_) + size);
+    if (NULL == block)
+    {
+        return (json_t){0};
+    }
+    block->allocator = allocator;
+    json_t clone = json_clone_compact(block + 1, size, obj);
+    if (NULL == clone.buf)
+    {
+        allocator->free(allocator->ctx, block, sizeof(union block_) + size);
+    }
+    return clone;
+}
+
+#ifdef JSON_HAS_ATOMIC
+/*
+ * Publish obj, frozen, to the readers of ref and free the object it
+ * replaces once they are done with it. ref then owns obj.
+ */
+int emJSON_atomic_publish(json_atomic_ref_t *ref, json_t *obj)
+{
+    json_t old = json_atomic_publish(ref, obj);
+    if (NULL != old.buf)
+    {
+        emJSON_free(&old);
+    }
+    return 0;
+}
+
+// Like json_make_concurrent(), growing the objects with no room for it.
+int emJSON_make_concurrent(json_t *obj)
+{
+    int ret = json_make_concurrent(obj);
+    if (JSON_BUFFER_FULL == ret)
+    {
+        ret = concurrent_grow_(obj);
+        ret = (JSON_OK == ret) ? json_make_concurrent(obj) : ret;
+    }
+    return ret;
+}
+#endif
+
 int emJSON_free(json_t *obj)
 {
-    // free buffer
-    free(obj->buf);
+    // free buffer, and the ones of its children
+    free_links_(obj);
+    free_block_(obj);
+    obj->buf = NULL;
     return 0;
 }
 
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+
+// An object of size bytes, from allocator.
+static json_t init_sized_(const emJSON_allocator_t *allocator, size_t size, size_t table_size)
+{
+    union block_ *block = allocator->alloc(allocator->ctx, sizeof(union block_) + size);
+    if (NULL == block)
+    {
+        return (json_t){0};
+    }
+    block->allocator = allocator;
+    json_t obj = json_init(block + 1, size, table_size);
+    if (NULL == obj.buf)
+    {
+        allocator->free(allocator->ctx, block, sizeof(union block_) + size);
+    }
+    return obj;
+}
+
+// Parse as parse_range_() does, growing obj as needed.
+static int parse_with_(json_t *obj, char *input, char *stop, int borrow)
+{
+    int ret;
+    ret = parse_range_(obj, input, stop, borrow);
+    
+    // json_parse() returns the length parsed on success
+    while (ret < 0)
+    {
+        switch (ret)
+        {
+        case JSON_KEY_EXISTS:
+        case JSON_FROZEN:
+            return ret;
+        case JSON_TABLE_FULL:
+            emJSON_clear(obj);
+            ret = json_double_table(obj);
+            if (JSON_OK == ret)
+            {
+                ret = parse_range_(obj, input, stop, borrow);
+            }
+            break;
+        case JSON_BUFFER_FULL:
+            // Double it, as everything is parsed again each time.
+            if (JSON_OK != grow_buffer_(obj, json_buffer_size(obj)))
+            {
+                return JSON_BUFFER_FULL;
+            }
+            emJSON_clear(obj);
+            ret = parse_range_(obj, input, stop, borrow);
+            break;
+        default:
+            return JSON_ERROR;
+        }
+    }
+    return JSON_OK;
+}
+
+// Make room in obj after an insertion failed by ret. JSON_OK to try again.
+static int make_room_(json_t *obj, int ret)
+{
+    switch (ret)
+    {
+    case JSON_TABLE_FULL:
+        ret = json_double_table(obj);
+        // grow first if there is no room for a bigger table
+        return (JSON_BUFFER_FULL == ret) ? grow_buffer_(obj, 32) : ret;
+    case JSON_BUFFER_FULL:
+        return grow_buffer_(obj, 32);
+    case JSON_KEY_EXISTS:
+    case JSON_FROZEN:
+        return ret;
+    default:
+        return JSON_ERROR;
+    }
+}
+
+/*
+ * A child in the buffer of its parent is moved to a block of its own, so
+ * that the parent stays as it is.
+ */
+static int grow_buffer_(json_t *obj, size_t increment)
+{
+    const emJSON_allocator_t *allocator = owner_allocator_(obj);
+    int is_block = is_block_(obj);
+    size_t old_size = json_buffer_size(obj);
+    size_t buf_size = old_size + increment;
+    union block_ *block;
+    if (is_block && NULL != allocator->realloc)
+    {   // It may grow in place. Otherwise only the pointers are moved.
+        void *old_buf = obj->buf;
+        block = allocator->realloc(allocator->ctx, block_ptr_(obj),
+                sizeof(union block_) + old_size, sizeof(union block_) + buf_size);
+        if (NULL == block)
+        {
+            return JSON_BUFFER_FULL;
+        }
+        obj->buf = block + 1;
+        json_relocate(obj, old_buf);
+        memset((uint8_t *)obj->buf + old_size, 0, increment);
+        buf_size_(obj) = buf_size;
+        return JSON_OK;
+    }
+    block = allocator->alloc(allocator->ctx, sizeof(union block_) + buf_size);
+    if (NULL == block)
+    {
+        return JSON_BUFFER_FULL;
+    }
+    block->allocator = allocator;
+    union block_ *old_block = block_ptr_(obj);
+    json_replace_buffer(obj, block + 1, buf_size);
+    if (is_block)
+    {
+        allocator->free(allocator->ctx, old_block, sizeof(union block_) + old_size);
+    }
+    return JSON_OK;
+}
+
+#ifdef JSON_HAS_ATOMIC
+// Children first, as a child that grows is moved out of its parent.
+static int concurrent_grow_(json_t *obj)
+{
+    for (size_t i = 0; i < json_table_size(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL != entry->key && JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            int ret = concurrent_grow_(&child);
+            if (JSON_OK != ret)
+            {
+                return ret;
+            }
+        }
+    }
+    size_t room = concurrent_room_(obj);
+    if (room > buf_size_(obj) - buf_idx_(obj))
+    {   // the alignment may change with the buffer
+        return grow_buffer_(obj, room + 3);
+    }
+    return JSON_OK;
+}
+#endif
+
+// Whether obj is a block of emJSON: a root object, or a linked child.
+static int is_block_(json_t *obj)
+{
+    if (NULL == parent_ptr_(obj))
+    {
+        return 1;
+    }
+    json_t parent = {
+            .buf = parent_ptr_(obj)
+    };
+    return table_ptr_(&parent)[idx_in_parent_(obj)].flags & ENTRY_LINKED_;
+}
+
+// The allocator of obj, or of the block it is in.
+static const emJSON_allocator_t *owner_allocator_(json_t *obj)
+{
+    json_t owner = *obj;
+    while (!is_block_(&owner))
+    {
+        owner.buf = parent_ptr_(&owner);
+    }
+    return allocator_(&owner);
+}
+
+// Free the linked children of obj, at any depth.
+static void free_links_(json_t *obj)
+{
+    for (size_t i = 0; i < json_table_size(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key || JSON_OBJECT != entry->value_type)
+        {
+            continue;
+        }
+        json_t child = {
+                .buf = entry->value_ptr
+        };
+        free_links_(&child);
+        if (entry->flags & ENTRY_LINKED_)
+        {
+            free_block_(&child);
+        }
+    }
+}
+
+static void free_block_(json_t *obj)
+{
+    const emJSON_allocator_t *allocator = allocator_(obj);
+    allocator->free(allocator->ctx, block_ptr_(obj),
+            sizeof(union block_) + json_buffer_size(obj));
+}
+
+// Class of a block of size bytes, EMJSON_POOL_CLASSES if too big.
+static size_t pool_class_(size_t size)
+{
+    size_t class = 0;
+    while (class < EMJSON_POOL_CLASSES && pool_block_size_(class) < size)
+    {
+        class++;
+    }
+    return class;
+}
+
+static void *pooled_alloc_(void *ctx, size_t size)
+{
+    (void)ctx;
+    size_t class = pool_class_(size);
+    return malloc((class < EMJSON_POOL_CLASSES) ? pool_block_size_(class) : size);
+}
+
+static void *pooled_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    (void)ctx;
+    size_t class = pool_class_(old_size);
+    if (class < EMJSON_POOL_CLASSES && new_size <= pool_block_size_(class))
+    {   // still in the block
+        return ptr;
+    }
+    class = pool_class_(new_size);
+    return realloc(ptr, (class < EMJSON_POOL_CLASSES) ? pool_block_size_(class) : new_size);
+}
+
+static void *libc_alloc_(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+static void *libc_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    (void)ctx;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void libc_free_(void *ctx, void *ptr, size_t size)
+{
+    (void)ctx;
+    (void)size;
+    free(ptr);
+}
+
+#ifdef EMJSON_HAS_THREADS
+/*
+ * Run fn for each part, in a thread of its own but the first, which runs
+ * here. A part whose thread cannot be started runs here as well.
+ */
+static void run_parts_(struct part_ *part, size_t count, void *(*fn)(void *))
+{
+    pthread_t thread[EMJSON_PARALLEL_MAX_THREADS];
+    int started[EMJSON_PARALLEL_MAX_THREADS];
+    for (size_t k = 1; k < count; k++)
+    {
+        started[k] = (0 == pthread_create(thread + k, NULL, fn, part + k));
+    }
+    fn(part);
+    for (size_t k = 1; k < count; k++)
+    {
+        if (started[k])
+        {
+            pthread_join(thread[k], NULL);
+        }
+        else
+        {
+            fn(part + k);
+        }
+    }
+}
+
+static void *scan_slice_(void *arg)
+{
+    struct part_ *part = arg;
+    scan_range_(part->begin, part->end, &part->scan);
+    return NULL;
+}
+
+/*
+ * Parse a part into a buffer from malloc(), which any thread can use. It is
+ * sized for the most it can take, so that it is parsed once: keys and
+ * strings in slots, tables twice their entries, and a header and a table
+ * of 4 for each nested object.
+ */
+static void *parse_part_(void *arg)
+{
+    struct part_ *part = arg;
+    struct part_count_ count;
+    count_part_(part->begin, part->end, &count);
+    size_t table_size = EMJSON_INIT_TABLE_SIZE;
+    while (table_size < count.members)
+    {
+        table_size <<= 1;
+    }
+    size_t size = sizeof(struct header_) + table_size * sizeof(struct entry_) +
+            (part->end - part->begin) +
+            count.values * (8 + 2 * sizeof(struct entry_)) +
+            count.objects * (sizeof(struct header_) + 4 * sizeof(struct entry_));
+    part->obj = init_sized_(&libc_allocator_, size, table_size);
+    if (NULL == part->obj.buf)
+    {
+        part->status = JSON_BUFFER_FULL;
+        return NULL;
+    }
+    part->status = parse_with_(&part->obj, part->begin, part->end, 0);
+    return NULL;
+}
+
+static void *copy_part_(void *arg)
+{
+    struct part_ *part = arg;
+    join_copy_(part->dest, &part->obj, part->offset);
+    return NULL;
+}
+
+/*
+ * Join the parts into obj, sized for them: the contents are copied at once,
+ * then the entries are put into the table.
+ */
+static int join_parts_(json_t *obj, struct part_ *part, size_t count)
+{
+    json_t joined[EMJSON_PARALLEL_MAX_THREADS];
+    for (size_t k = 0; k < count; k++)
+    {
+        joined[k] = part[k].obj;
+    }
+    size_t size = join_size_(joined, count);
+    if (size > json_buffer_size(obj) &&
+        JSON_OK != grow_buffer_(obj, size - json_buffer_size(obj)))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    int ret = join_init_(obj, joined, count);
+    if (JSON_OK != ret)
+    {
+        return ret;
+    }
+    size_t offset = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        part[k].dest = obj;
+        part[k].offset = offset;
+        offset += join_offset_(joined + k);
+    }
+    run_parts_(part, count, copy_part_);
+    ret = join_table_(obj, joined, count);
+    if (JSON_OK != ret)
+    {
+        emJSON_clear(obj);
+    }
+    return ret;
+}
+#endif
+
 // pointer macros
 #undef  header_ptr_
 
@@ -10,14 +10,115 @@
 #ifndef EMJSON_INIT_TABLE_SIZE
     #define EMJSON_INIT_TABLE_SIZE  4
 #endif
+// Buffer pool of emJSON_init_pooled(): the smallest block, the number of
+// size classes (each twice the last), and the blocks kept in each class.
+#ifndef EMJSON_POOL_MIN_SIZE
+    #define EMJSON_POOL_MIN_SIZE    256
+#endif
+#ifndef EMJSON_POOL_CLASSES
+    #define EMJSON_POOL_CLASSES     10
+#endif
+#ifndef EMJSON_POOL_DEPTH
+    #define EMJSON_POOL_DEPTH       8
+#endif
+// emJSON_parse_parallel(), where there are POSIX threads: inputs shorter
+// than this are parsed in one thread, and at most this many threads are used.
+#if defined(__unix__) || defined(__APPLE__)
+    #define EMJSON_HAS_THREADS
+#endif
+#ifndef EMJSON_PARALLEL_MIN_SIZE
+    #define EMJSON_PARALLEL_MIN_SIZE    (64 * 1024)
+#endif
+#ifndef EMJSON_PARALLEL_MAX_THREADS
+    #define EMJSON_PARALLEL_MAX_THREADS 64
+#endif
+// emJSON_stream_feed(): the deepest nesting, deeper ones being errors, and
+// the first size of the buffer of a key and a value, which grows as needed.
+#ifndef EMJSON_STREAM_DEPTH
+    #define EMJSON_STREAM_DEPTH     8
+#endif
+#ifndef EMJSON_STREAM_TOKEN
+    #define EMJSON_STREAM_TOKEN     128
+#endif
+
+// Memory allocator of emJSON objects. free() and realloc() are given the
+// size the block was allocated with. realloc may be NULL.
+typedef struct emJSON_allocator
+{
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+}emJSON_allocator_t;
+
+// Bump allocator over a given buffer. Blocks are released all at once by
+// emJSON_arena_reset(); only the last block can grow in place or be freed.
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t idx;
+    size_t last;		// offset of the last block
+    emJSON_allocator_t allocator;
+}emJSON_arena_t;
+
+// Allocator of fixed-size blocks in a given buffer. Blocks are released one
+// by one or all at once by emJSON_pool_reset().
+typedef struct
+{
+    uint8_t *buf;
+    size_t block_size;
+    size_t block_count;
+    size_t unused_idx;	// blocks from here have never been given
+    void *free_list;
+    emJSON_allocator_t allocator;
+}emJSON_pool_t;
+
+// Buffers of emJSON_init_pooled() in this thread, by emJSON_pooled_stats().
+typedef struct
+{
+    size_t hits;		// buffers reused
+    size_t misses;		// buffers allocated
+    size_t cached;		// buffers kept now
+}emJSON_pooled_stats_t;
+
+// Resumable parser of objects that arrive in pieces, as from a socket.
+// Only the object being parsed and the key and value in progress are kept;
+// the text is not. emJSON_stream_end() frees the buffer of the latter.
+typedef struct
+{
+    json_t obj[EMJSON_STREAM_DEPTH];	// the object being parsed, then its open children
+    size_t depth;		// open objects
+    char *token;		// the key, its '\0', then the value in progress
+    size_t size;		// of token
+    size_t key_len;
+    size_t len;			// of the value
+    uint8_t state;
+}emJSON_stream_t;
 
 #ifdef __cplusplus
 extern "C"{
 #endif
 
+// Allocator functions
+void emJSON_set_allocator(const emJSON_allocator_t *allocator);
+void emJSON_arena_init(emJSON_arena_t *arena, void *buf, size_t size);
+void emJSON_arena_reset(emJSON_arena_t *arena);
+void emJSON_pool_init(emJSON_pool_t *pool, void *buf, size_t size, size_t block_size);
+void emJSON_pool_reset(emJSON_pool_t *pool);
+
 // high-level functions
 json_t emJSON_init(void);
+json_t emJSON_init_with(const emJSON_allocator_t *allocator);
+json_t emJSON_init_pooled(void);
+int emJSON_release(json_t *obj);
+void emJSON_pooled_stats(emJSON_pooled_stats_t *stats);
+void emJSON_pooled_drain(void);
 int emJSON_parse(json_t *obj, char *input);
+int emJSON_parse_borrowed(json_t *obj, char *input);
+#ifdef EMJSON_HAS_THREADS
+int emJSON_parse_parallel(json_t *obj, char *input, int thread_count);
+#endif
 int emJSON_delete(json_t *obj, char *key);
 int emJSON_clear(json_t *obj);
 
@@ -26,6 +127,8 @@ int emJSON_insert(json_t *obj, char *key, void *value, json_type_t type);
 int emJSON_insert_str(json_t *obj, char *key, char *value);
 int emJSON_insert_int(json_t *obj, char *key, int value);
 int emJSON_insert_float(json_t *obj, char *key, float value);
+int emJSON_insert_batch(json_t *obj, const json_member_t *items, size_t n);
+json_t emJSON_insert_empty_obj(json_t *obj, char *key);
 
 // Getter functions
 void *emJSON_get(json_t *obj, char *key, json_type_t type);
@@ -38,12 +141,27 @@ int emJSON_set(json_t *obj, char *key, void *value);
 int emJSON_set_str(json_t *obj, char *key, char *value);
 int emJSON_set_int(json_t *obj, char *key, int value);
 int emJSON_set_float(json_t *obj, char *key, float value);
+int emJSON_add_int(json_t *obj, char *key, int value);
+int emJSON_add_float(json_t *obj, char *key, float value);
+int emJSON_increment(json_t *obj, char *key);
 
 // String-related functions
 char *emJSON_string(json_t *obj);
+int emJSON_free_str(char *str);
 int emJSON_strcpy(char *dest, json_t *obj);
 
+// Parsing a stream of objects
+void emJSON_stream_init(emJSON_stream_t *stream);
+int emJSON_stream_feed(emJSON_stream_t *stream, const char *data, size_t len, size_t *used);
+json_t emJSON_stream_take(emJSON_stream_t *stream);
+int emJSON_stream_end(emJSON_stream_t *stream);
+
+json_t emJSON_clone(json_t *obj);
 int emJSON_free(json_t *obj);
+#ifdef JSON_HAS_ATOMIC
+int emJSON_atomic_publish(json_atomic_ref_t *ref, json_t *obj);
+int emJSON_make_concurrent(json_t *obj);
+#endif
 
 #ifdef __cplusplus
 }
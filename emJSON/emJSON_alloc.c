@@ -0,0 +1,161 @@
+#include "emJSON.h"
+#include <string.h>
+
+// Blocks are aligned to this.
+#define ALLOC_ALIGN     16
+#define align_(size)    (((size) + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1))
+
+static void *arena_alloc_(void *ctx, size_t size);
+static void *arena_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size);
+static void arena_free_(void *ctx, void *ptr, size_t size);
+static void *pool_alloc_(void *ctx, size_t size);
+static void *pool_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size);
+static void pool_free_(void *ctx, void *ptr, size_t size);
+
+/*******************************************************************************
+ * Arena allocator
+ ******************************************************************************/
+
+/*
+ * Use buf for emJSON objects and strings, by emJSON_init_with(&arena->allocator).
+ * Freeing is only needed for the last block; emJSON_arena_reset() releases all.
+ */
+void emJSON_arena_init(emJSON_arena_t *arena, void *buf, size_t size)
+{
+    // align the start of the buffer
+    size_t skip = align_((uintptr_t)buf) - (uintptr_t)buf;
+    skip = (skip > size) ? size : skip;
+    *arena = (emJSON_arena_t){
+        .buf = (uint8_t *)buf + skip,
+        .size = size - skip,
+        .idx = 0,
+        .last = (size_t)-1,
+        .allocator = {
+            .alloc = arena_alloc_,
+            .realloc = arena_realloc_,
+            .free = arena_free_,
+            .ctx = arena
+        }
+    };
+}
+
+void emJSON_arena_reset(emJSON_arena_t *arena)
+{
+    arena->idx = 0;
+    arena->last = (size_t)-1;
+}
+
+static void *arena_alloc_(void *ctx, size_t size)
+{
+    emJSON_arena_t *arena = ctx;
+    size = align_(size);
+    if (size > arena->size - arena->idx)
+    {
+        return NULL;
+    }
+    arena->last = arena->idx;
+    arena->idx += size;
+    return arena->buf + arena->last;
+}
+
+static void *arena_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    emJSON_arena_t *arena = ctx;
+    if ((uint8_t *)ptr == arena->buf + arena->last)
+    {   // the last block grows in place
+        if (align_(new_size) > arena->size - arena->last)
+        {
+            return NULL;
+        }
+        arena->idx = arena->last + align_(new_size);
+        return ptr;
+    }
+    void *new_ptr = arena_alloc_(ctx, new_size);
+    if (NULL != new_ptr)
+    {
+        memcpy(new_ptr, ptr, (old_size < new_size) ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+static void arena_free_(void *ctx, void *ptr, size_t size)
+{
+    emJSON_arena_t *arena = ctx;
+    (void)size;
+    if ((uint8_t *)ptr == arena->buf + arena->last)
+    {   // only the last one is given back
+        arena->idx = arena->last;
+        arena->last = (size_t)-1;
+    }
+}
+
+/*******************************************************************************
+ * Pool allocator
+ ******************************************************************************/
+
+/*
+ * Cut buf into blocks of block_size bytes. A request bigger than a block
+ * fails, so block_size should hold the biggest object expected, including
+ * its growth.
+ */
+void emJSON_pool_init(emJSON_pool_t *pool, void *buf, size_t size, size_t block_size)
+{
+    size_t skip = align_((uintptr_t)buf) - (uintptr_t)buf;
+    skip = (skip > size) ? size : skip;
+    block_size = align_((block_size < sizeof(void *)) ? sizeof(void *) : block_size);
+    *pool = (emJSON_pool_t){
+        .buf = (uint8_t *)buf + skip,
+        .block_size = block_size,
+        .block_count = (size - skip) / block_size,
+        .unused_idx = 0,
+        .free_list = NULL,
+        .allocator = {
+            .alloc = pool_alloc_,
+            .realloc = pool_realloc_,
+            .free = pool_free_,
+            .ctx = pool
+        }
+    };
+}
+
+void emJSON_pool_reset(emJSON_pool_t *pool)
+{
+    pool->unused_idx = 0;
+    pool->free_list = NULL;
+}
+
+static void *pool_alloc_(void *ctx, size_t size)
+{
+    emJSON_pool_t *pool = ctx;
+    if (size > pool->block_size)
+    {
+        return NULL;
+    }
+    if (NULL != pool->free_list)
+    {   // the next free block is stored at the start of a free block
+        void *ptr = pool->free_list;
+        memcpy(&pool->free_list, ptr, sizeof(void *));
+        return ptr;
+    }
+    if (pool->unused_idx < pool->block_count)
+    {
+        return pool->buf + pool->block_size * pool->unused_idx++;
+    }
+    return NULL;
+}
+
+static void *pool_realloc_(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    emJSON_pool_t *pool = ctx;
+    (void)old_size;
+    // every block is as big as it can be
+    return (new_size <= pool->block_size) ? ptr : NULL;
+}
+
+static void pool_free_(void *ctx, void *ptr, size_t size)
+{
+    emJSON_pool_t *pool = ctx;
+    (void)size;
+    memcpy(ptr, &pool->free_list, sizeof(void *));
+    pool->free_list = ptr;
+}
@@ -0,0 +1,339 @@
+#include "emJSON.h"
+#include "json_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * States of the stream parser: the ones of parse_(), then the ones inside a
+ * key, a string or a number, where a piece of input can end. A key and a
+ * value are copied until they are complete; everything else is put into
+ * the object as it comes.
+ */
+enum
+{
+    stream_idle = parse_state_count_,	// before an object
+    stream_key,
+    stream_colon,
+    stream_str,
+    stream_number,
+    stream_next,		// after a value
+    stream_error
+};
+
+static int copy_until_quote_(emJSON_stream_t *stream, size_t *len, size_t at,
+        const char **i, const char *end);
+static int append_(emJSON_stream_t *stream, size_t at, const char *src, size_t n);
+static int insert_number_(emJSON_stream_t *stream);
+static void reset_(emJSON_stream_t *stream);
+static int is_number_char_(char input);
+
+/*******************************************************************************
+ * Stream parser
+ ******************************************************************************/
+
+void emJSON_stream_init(emJSON_stream_t *stream)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->state = stream_idle;
+}
+
+/*
+ * Parse len bytes of data, going on from where the last call stopped. It
+ * stops after each complete object and returns 1: take it with
+ * emJSON_stream_take(), then feed the rest of data. *used is the number of
+ * bytes parsed. Returns 0 when all of data is used, or an error code, after
+ * which the stream is to be ended.
+ */
+int emJSON_stream_feed(emJSON_stream_t *stream, const char *data, size_t len, size_t *used)
+{
+    const char *i = data;
+    const char *end = data + len;
+    int ret = 0;
+    if (parse_end_ == stream->state || stream_error == stream->state)
+    {
+        *used = 0;
+        return (parse_end_ == stream->state) ? 1 : JSON_ERROR;
+    }
+    while (i < end && 0 == ret)
+    {
+        switch (stream->state)
+        {
+        case stream_idle:
+            if (is_ws_(*i))
+            {
+                i += 1;
+                break;
+            }
+            if (*i != '{')
+            {
+                ret = JSON_ERROR;
+                break;
+            }
+            stream->obj[0] = emJSON_init();
+            if (NULL == stream->obj[0].buf)
+            {
+                ret = JSON_BUFFER_FULL;
+                break;
+            }
+            stream->depth = 1;
+            stream->state = parse_start_;
+            i += 1;
+            break;
+        case parse_start_:
+        case parse_name_:
+            if (is_ws_(*i))
+            {
+                i += 1;
+            }
+            else if (*i == '"')
+            {
+                stream->key_len = 0;
+                stream->state = stream_key;
+                i += 1;
+            }
+            else if (*i == '}' && parse_start_ == stream->state)
+            {
+                stream->state = stream_next;
+            }
+            else
+            {
+                ret = JSON_ERROR;
+            }
+            break;
+        case stream_key:
+            ret = copy_until_quote_(stream, &stream->key_len, 0, &i, end);
+            if (1 == ret)
+            {
+                stream->state = stream_colon;
+                ret = 0;
+            }
+            break;
+        case stream_colon:
+            if (is_ws_(*i))
+            {
+                i += 1;
+            }
+            else if (*i == ':')
+            {
+                stream->state = parse_value_;
+                i += 1;
+            }
+            else
+            {
+                ret = JSON_ERROR;
+            }
+            break;
+        case parse_value_:
+            stream->len = 0;
+            if (is_ws_(*i))
+            {
+                i += 1;
+            }
+            else if (*i == '"')
+            {
+                stream->state = stream_str;
+                i += 1;
+            }
+            else if (*i == '-' || ('0' <= *i && *i <= '9'))
+            {
+                stream->state = stream_number;
+            }
+            else if (*i == '{')
+            {
+                if (EMJSON_STREAM_DEPTH == stream->depth)
+                {
+                    ret = JSON_ERROR;
+                    break;
+                }
+                json_t child = emJSON_insert_empty_obj(stream->obj + stream->depth - 1,
+                        stream->token);
+                if (NULL == child.buf)
+                {
+                    ret = JSON_ERROR;
+                    break;
+                }
+                stream->obj[stream->depth++] = child;
+                stream->state = parse_start_;
+                i += 1;
+            }
+            else
+            {
+                ret = JSON_ERROR;
+            }
+            break;
+        case stream_str:
+            ret = copy_until_quote_(stream, &stream->len, stream->key_len + 1, &i, end);
+            if (1 == ret)
+            {
+                ret = emJSON_insert(stream->obj + stream->depth - 1, stream->token,
+                        stream->token + stream->key_len + 1, JSON_STRING);
+                stream->state = stream_next;
+            }
+            break;
+        case stream_number:
+        {   // it ends at the first other character, which may be in the next piece
+            const char *start = i;
+            while (i < end && is_number_char_(*i))
+            {
+                i += 1;
+            }
+            ret = append_(stream, stream->key_len + 1 + stream->len, start, i - start);
+            stream->len += i - start;
+            if (i < end && 0 == ret)
+            {
+                ret = insert_number_(stream);
+                stream->state = stream_next;
+            }
+            break;
+        }
+        case stream_next:
+            if (is_ws_(*i))
+            {
+                i += 1;
+            }
+            else if (*i == ',')
+            {
+                stream->state = parse_name_;
+                i += 1;
+            }
+            else if (*i == '}')
+            {
+                i += 1;
+                stream->depth -= 1;
+                if (0 == stream->depth)
+                {
+                    stream->state = parse_end_;
+                    ret = 1;
+                }
+            }
+            else
+            {
+                ret = JSON_ERROR;
+            }
+            break;
+        default:
+            ret = JSON_ERROR;
+            break;
+        }
+    }
+    *used = i - data;
+    if (ret < 0)
+    {
+        stream->state = stream_error;
+    }
+    return ret;
+}
+
+/*
+ * The object emJSON_stream_feed() completed, to be freed by emJSON_free(),
+ * or an object with a NULL buffer if there is none.
+ */
+json_t emJSON_stream_take(emJSON_stream_t *stream)
+{
+    if (parse_end_ != stream->state)
+    {
+        return (json_t){0};
+    }
+    json_t obj = stream->obj[0];
+    reset_(stream);
+    return obj;
+}
+
+/*
+ * The end of the input. The object being parsed, if any, is freed, and the
+ * stream can be used again. Returns JSON_ERROR if the input ended inside an
+ * object or after an error.
+ */
+int emJSON_stream_end(emJSON_stream_t *stream)
+{
+    int ret = (stream_idle == stream->state || parse_end_ == stream->state) ?
+            JSON_OK : JSON_ERROR;
+    if (stream_idle != stream->state && NULL != stream->obj[0].buf)
+    {   // children are freed with it
+        emJSON_free(&stream->obj[0]);
+    }
+    free(stream->token);
+    emJSON_stream_init(stream);
+    return ret;
+}
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+
+// Copy up to the closing quote to token + at, after *len bytes copied
+// before. Returns 1 at the quote.
+static int copy_until_quote_(emJSON_stream_t *stream, size_t *len, size_t at,
+        const char **i, const char *end)
+{
+    const char *quote = memchr(*i, '"', end - *i);
+    size_t n = ((NULL != quote) ? quote : end) - *i;
+    if (JSON_OK != append_(stream, at + *len, *i, n))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    *len += n;
+    *i += n;
+    if (NULL == quote)
+    {
+        return 0;
+    }
+    stream->token[at + *len] = '\0';
+    *i += 1;
+    return 1;
+}
+
+// Copy n bytes to token + at, growing it with room for a '\0' after them.
+static int append_(emJSON_stream_t *stream, size_t at, const char *src, size_t n)
+{
+    if (at + n + 1 > stream->size)
+    {
+        size_t size = (0 != stream->size) ? stream->size : EMJSON_STREAM_TOKEN;
+        while (at + n + 1 > size)
+        {
+            size *= 2;
+        }
+        char *token = realloc(stream->token, size);
+        if (NULL == token)
+        {
+            return JSON_BUFFER_FULL;
+        }
+        stream->token = token;
+        stream->size = size;
+    }
+    memcpy(stream->token + at, src, n);
+    return JSON_OK;
+}
+
+static int insert_number_(emJSON_stream_t *stream)
+{
+    union
+    {
+        int32_t i;
+        float f;
+    } value;
+    char *number = stream->token + stream->key_len + 1;
+    number[stream->len] = '\0';
+    json_type_t type = number_value_(number, &value);
+    if (JSON_UNKNOWN == type)
+    {
+        return JSON_ERROR;
+    }
+    return emJSON_insert(stream->obj + stream->depth - 1, stream->token, &value, type);
+}
+
+// Ready for the next object, keeping the buffer of token.
+static void reset_(emJSON_stream_t *stream)
+{
+    char *token = stream->token;
+    size_t size = stream->size;
+    emJSON_stream_init(stream);
+    stream->token = token;
+    stream->size = size;
+}
+
+static int is_number_char_(char input)
+{
+    return ('0' <= input && input <= '9') || input == '-' || input == '.' ||
+            input == 'e' || input == 'E';
+}
@@ -0,0 +1,656 @@
+#ifndef __EMJSON_HPP__
+#define __EMJSON_HPP__
+
+/*
+ * C++17 interface of emJSON. json::object owns an object of emJSON and
+ * frees it; json::view refers to one, such as a nested object. Every
+ * function is inline and calls the C function of its type, so nothing is
+ * added to the C API.
+ * Keys are given as const char * or std::string_view. A string_view key is
+ * looked up by its hash, without being copied; it is copied only to be
+ * inserted, on the stack if it is short. A key of "name"_k is hashed at
+ * compile time, for obj["name"_k].
+ * json::static_object holds its buffer, sized at compile time, and never
+ * grows; fixed_view is a view of such an object.
+ * Structs with a json::binding are parsed and written by parse_into() and
+ * write_from(), without an object in between. json::stream parses objects
+ * as they arrive; emjson_async.hpp runs it in coroutines.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include "emJSON.h"
+
+namespace json
+{
+
+/*
+ * json_hash() of str, at compile time when str is known. It is the default
+ * EMJSON_HASH of json.c, which must be changed with it.
+ */
+constexpr std::int32_t hash(std::string_view str) noexcept
+{
+    std::uint32_t result = 0;
+    for (char cha : str)
+    {
+        result = (result << 5) - result + static_cast<std::uint32_t>(cha);
+    }
+    result ^= static_cast<std::uint32_t>(str.size());
+    return static_cast<std::int32_t>(result);
+}
+
+// A key with its hash, made by "name"_k.
+struct key
+{
+    std::string_view name;
+    std::int32_t hash;
+};
+
+namespace literals
+{
+
+constexpr key operator""_k(const char *str, std::size_t len) noexcept
+{
+    return key{std::string_view(str, len), json::hash(std::string_view(str, len))};
+}
+
+}  // namespace literals
+
+namespace detail
+{
+
+// A null-terminated copy of a string, on the stack if it is short.
+class c_str
+{
+public:
+    explicit c_str(std::string_view str)
+        : ptr_((str.size() < sizeof(buf_)) ? buf_ : new char[str.size() + 1])
+    {
+        std::memcpy(ptr_, str.data(), str.size());
+        ptr_[str.size()] = '\0';
+    }
+    ~c_str()
+    {
+        if (ptr_ != buf_)
+        {
+            delete[] ptr_;
+        }
+    }
+    c_str(const c_str &) = delete;
+    c_str &operator=(const c_str &) = delete;
+
+    char *get() const noexcept { return ptr_; }
+
+private:
+    char buf_[64];
+    char *ptr_;
+};
+
+// How a view adds to its object: by growing its buffer, or within it.
+struct growing
+{
+    static int insert_int(json_t *obj, char *key, int value) { return emJSON_insert_int(obj, key, value); }
+    static int insert_float(json_t *obj, char *key, float value) { return emJSON_insert_float(obj, key, value); }
+    static int insert_str(json_t *obj, char *key, char *value) { return emJSON_insert_str(obj, key, value); }
+    static int set_str(json_t *obj, char *key, char *value) { return emJSON_set_str(obj, key, value); }
+    static json_t insert_object(json_t *obj, char *key, std::size_t size)
+    {
+        (void)size;
+        return emJSON_insert_empty_obj(obj, key);
+    }
+    static int erase(json_t *obj, char *key) { return emJSON_delete(obj, key); }
+};
+
+// For objects of json_init(), which the functions of emJSON.h must not grow.
+struct fixed
+{
+    static int insert_int(json_t *obj, char *key, int value) { return json_insert_int(obj, key, value); }
+    static int insert_float(json_t *obj, char *key, float value) { return json_insert_float(obj, key, value); }
+    static int insert_str(json_t *obj, char *key, char *value) { return json_insert_str(obj, key, value); }
+    static int set_str(json_t *obj, char *key, char *value) { return json_set_str(obj, key, value); }
+    static json_t insert_object(json_t *obj, char *key, std::size_t size)
+    {
+        if (JSON_OK != json_insert_empty_obj(obj, key, size))
+        {
+            return json_t{};
+        }
+        return json_get_obj(obj, key);
+    }
+    static int erase(json_t *obj, char *key) { return json_delete(obj, key); }
+};
+
+// The C functions for each type of value. Other types do not compile.
+template <typename T>
+struct value_traits;
+
+template <>
+struct value_traits<int>
+{
+    static constexpr json_type_t type = JSON_INT;
+    static constexpr bool is_number = true;
+    using stored = int;
+    static int get(json_t *obj, char *key) { return json_get_int(obj, key); }
+    static int from(const void *ptr)
+    {
+        int value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    template <typename Room>
+    static int set(json_t *obj, char *key, int value) { return json_set_int(obj, key, value); }
+    template <typename Room>
+    static int insert(json_t *obj, char *key, int value) { return Room::insert_int(obj, key, value); }
+};
+
+template <>
+struct value_traits<float>
+{
+    static constexpr json_type_t type = JSON_FLOAT;
+    static constexpr bool is_number = true;
+    using stored = float;
+    static float get(json_t *obj, char *key) { return json_get_float(obj, key); }
+    static float from(const void *ptr)
+    {
+        float value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    template <typename Room>
+    static int set(json_t *obj, char *key, float value) { return json_set_float(obj, key, value); }
+    template <typename Room>
+    static int insert(json_t *obj, char *key, float value) { return Room::insert_float(obj, key, value); }
+};
+
+template <>
+struct value_traits<const char *>
+{
+    static constexpr json_type_t type = JSON_STRING;
+    static constexpr bool is_number = false;
+    static const char *get(json_t *obj, char *key) { return json_get_str(obj, key); }
+    static const char *from(const void *ptr) { return static_cast<const char *>(ptr); }
+    template <typename Room>
+    static int set(json_t *obj, char *key, const char *value)
+    {
+        return Room::set_str(obj, key, const_cast<char *>(value));
+    }
+    template <typename Room>
+    static int insert(json_t *obj, char *key, const char *value)
+    {
+        return Room::insert_str(obj, key, const_cast<char *>(value));
+    }
+};
+
+template <>
+struct value_traits<std::string_view>
+{
+    static constexpr json_type_t type = JSON_STRING;
+    static constexpr bool is_number = false;
+    static std::string_view get(json_t *obj, char *key)
+    {
+        const char *str = json_get_str(obj, key);
+        return (nullptr != str) ? std::string_view(str) : std::string_view();
+    }
+    static std::string_view from(const void *ptr) { return static_cast<const char *>(ptr); }
+    template <typename Room>
+    static int set(json_t *obj, char *key, std::string_view value)
+    {
+        c_str str(value);
+        return Room::set_str(obj, key, str.get());
+    }
+    template <typename Room>
+    static int insert(json_t *obj, char *key, std::string_view value)
+    {
+        c_str str(value);
+        return Room::insert_str(obj, key, str.get());
+    }
+};
+
+}  // namespace detail
+
+// A member of an object, as range-for gives it.
+class member
+{
+public:
+    explicit member(const json_member_t &member) noexcept : member_(member) {}
+
+    std::string_view key() const { return member_.key; }
+    json_type_t type() const noexcept { return member_.type; }
+
+    // The value, or T() if it is of another type.
+    template <typename T>
+    T get() const
+    {
+        using traits = detail::value_traits<T>;
+        return (traits::type == member_.type) ? traits::from(member_.value) : T();
+    }
+
+private:
+    json_member_t member_;
+};
+
+// Iterator over the members of an object, by json_next().
+class iterator
+{
+public:
+    iterator(json_t *obj, bool is_end) noexcept
+        : obj_(obj), next_(is_end ? end_ : 0), member_{}
+    {
+        if (!is_end)
+        {
+            ++*this;
+        }
+    }
+
+    iterator &operator++() noexcept
+    {
+        if (!json_next(obj_, &next_, &member_))
+        {
+            next_ = end_;
+        }
+        return *this;
+    }
+    member operator*() const noexcept { return member(member_); }
+    bool operator==(const iterator &other) const noexcept { return next_ == other.next_; }
+    bool operator!=(const iterator &other) const noexcept { return next_ != other.next_; }
+
+private:
+    static constexpr std::size_t end_ = static_cast<std::size_t>(-1);
+    json_t *obj_;
+    std::size_t next_;
+    json_member_t member_;
+};
+
+template <typename Room>
+class basic_view;
+
+// A member by a key of "name"_k, from operator[] of a view it refers to.
+template <typename Room>
+class basic_field
+{
+public:
+    basic_field(basic_view<Room> &obj, const key &k) noexcept : obj_(obj), key_(k) {}
+
+    // The value, or T() if there is none of type T.
+    template <typename T>
+    T get() const { return obj_.template get<T>(key_); }
+
+    template <typename T>
+    int set(T value) { return obj_.set(key_, value); }
+
+private:
+    basic_view<Room> &obj_;
+    key key_;
+};
+
+/*
+ * An object owned by something else: a nested object, or a json::object.
+ * It is as big as json_t and can be copied freely. Room tells how it adds
+ * members; use the aliases view and fixed_view.
+ */
+template <typename Room>
+class basic_view
+{
+public:
+    basic_view() noexcept = default;
+    explicit basic_view(json_t obj) noexcept : obj_(obj) {}
+
+    // For the C functions, which take no const objects.
+    json_t *c_obj() const noexcept { return const_cast<json_t *>(&obj_); }
+    explicit operator bool() const noexcept { return nullptr != obj_.buf; }
+
+    // The value of key, or T() if there is none of type T.
+    template <typename T>
+    T get(const char *key) const
+    {
+        return detail::value_traits<T>::get(c_obj(), const_cast<char *>(key));
+    }
+
+    template <typename T>
+    T get(std::string_view key) const { return get_hashed_<T>(json::hash(key)); }
+
+    template <typename T>
+    T get(const key &k) const { return get_hashed_<T>(k.hash); }
+
+    // Change the value of key. Returns a status code of emJSON.
+    template <typename T>
+    int set(const char *key, T value)
+    {
+        return detail::value_traits<T>::template set<Room>(c_obj(), const_cast<char *>(key), value);
+    }
+
+    template <typename T>
+    int set(std::string_view key, T value) { return set_hashed_(key, json::hash(key), value); }
+
+    template <typename T>
+    int set(const key &k, T value) { return set_hashed_(k.name, k.hash, value); }
+
+    basic_field<Room> operator[](const key &k) noexcept { return basic_field<Room>(*this, k); }
+
+    template <typename T>
+    int insert(const char *key, T value)
+    {
+        return detail::value_traits<T>::template insert<Room>(c_obj(), const_cast<char *>(key), value);
+    }
+
+    template <typename T>
+    int insert(std::string_view key, T value)
+    {
+        detail::c_str c_key(key);
+        return detail::value_traits<T>::template insert<Room>(c_obj(), c_key.get(), value);
+    }
+
+    /*
+     * A new empty object under key. It is false if it could not be added.
+     * A fixed object gives it size bytes of its buffer; a growing one
+     * ignores size.
+     */
+    basic_view insert_object(std::string_view key, std::size_t size = 0)
+    {
+        detail::c_str c_key(key);
+        return basic_view(Room::insert_object(c_obj(), c_key.get(), size));
+    }
+
+    int erase(std::string_view key)
+    {
+        detail::c_str c_key(key);
+        return Room::erase(c_obj(), c_key.get());
+    }
+
+    std::size_t size() const noexcept { return json_count(c_obj()); }
+    int length() const noexcept { return json_strlen(c_obj()); }
+
+    // Serialize into dest of size bytes. Returns the length of the output.
+    int write(char *dest, std::size_t size) const { return json_strncpy(dest, c_obj(), size); }
+
+    iterator begin() const noexcept { return iterator(c_obj(), false); }
+    iterator end() const noexcept { return iterator(c_obj(), true); }
+
+protected:
+    json_t obj_{};
+
+private:
+    template <typename T>
+    T get_hashed_(std::int32_t hash) const
+    {
+        using traits = detail::value_traits<T>;
+        void *ptr = json_get_hashed(c_obj(), hash, traits::type);
+        return (nullptr != ptr) ? traits::from(ptr) : T();
+    }
+
+    template <typename T>
+    int set_hashed_(std::string_view key, std::int32_t hash, T value)
+    {
+        using traits = detail::value_traits<T>;
+        if constexpr (traits::is_number)
+        {
+            typename traits::stored stored = static_cast<typename traits::stored>(value);
+            return json_set_hashed(c_obj(), hash, &stored);
+        }
+        else
+        {
+            detail::c_str c_key(key);
+            return traits::template set<Room>(c_obj(), c_key.get(), value);
+        }
+    }
+};
+
+using view = basic_view<detail::growing>;
+using fixed_view = basic_view<detail::fixed>;
+
+namespace detail
+{
+
+template <typename Room>
+struct value_traits<basic_view<Room>>
+{
+    static constexpr json_type_t type = JSON_OBJECT;
+    static constexpr bool is_number = false;
+    static basic_view<Room> get(json_t *obj, char *key) { return basic_view<Room>(json_get_obj(obj, key)); }
+    static basic_view<Room> from(const void *ptr)
+    {
+        json_t obj = {
+            const_cast<void *>(ptr)
+        };
+        return basic_view<Room>(obj);
+    }
+};
+
+}  // namespace detail
+
+/*
+ * An object of emJSON, freed with it. It can be moved but not copied;
+ * clone() makes a copy.
+ */
+class object : public view
+{
+public:
+    object() : view(emJSON_init()) {}
+    // Take over obj, from emJSON_init() or emJSON_clone().
+    explicit object(json_t obj) noexcept : view(obj) {}
+    ~object() { reset(); }
+
+    object(object &&other) noexcept : view(other.release()) {}
+    object &operator=(object &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            obj_ = other.release();
+        }
+        return *this;
+    }
+    object(const object &) = delete;
+    object &operator=(const object &) = delete;
+
+    object clone() const { return object(emJSON_clone(c_obj())); }
+
+    // Parse input into the object, as emJSON_parse() does.
+    int parse(char *input) { return emJSON_parse(&obj_, input); }
+
+    // Give up the object, to be freed by emJSON_free().
+    json_t release() noexcept
+    {
+        json_t obj = obj_;
+        obj_.buf = nullptr;
+        return obj;
+    }
+
+private:
+    void reset() noexcept
+    {
+        if (nullptr != obj_.buf)
+        {
+            emJSON_free(&obj_);
+        }
+    }
+};
+
+/*
+ * An object of json_init() in a buffer of BufBytes inside it, with a table of
+ * TableSlots. A table that is not a power of two, or that cannot fit in the
+ * buffer, does not compile. It never grows: adding to a full object returns
+ * JSON_BUFFER_FULL or JSON_TABLE_FULL. Neither copied nor moved, as the
+ * object is its buffer.
+ */
+template <std::size_t BufBytes, std::size_t TableSlots>
+class static_object : public fixed_view
+{
+    static_assert(0 != TableSlots && 0 == (TableSlots & (TableSlots - 1)),
+            "the table size of json_init() must be a power of 2");
+    static_assert(BufBytes >= JSON_INIT_SIZE(TableSlots),
+            "the buffer cannot hold the header and the table");
+
+public:
+    static_object() noexcept { obj_ = json_init(buf_, BufBytes, TableSlots); }
+    static_object(const static_object &) = delete;
+    static_object &operator=(const static_object &) = delete;
+
+    // Parse input into the object, as json_parse() does.
+    int parse(char *input) { return json_parse(&obj_, input); }
+
+    static constexpr std::size_t buffer_size = BufBytes;
+    static constexpr std::size_t table_size = TableSlots;
+
+private:
+    alignas(std::max_align_t) unsigned char buf_[BufBytes];
+};
+
+/*
+ * Resumable parser of objects arriving in pieces, by emJSON_stream_feed().
+ * The object being parsed is freed with it.
+ */
+class stream
+{
+public:
+    stream() noexcept { emJSON_stream_init(&stream_); }
+    ~stream() { emJSON_stream_end(&stream_); }
+    stream(const stream &) = delete;
+    stream &operator=(const stream &) = delete;
+
+    // Parse data, giving each object completed to on_object. Returns JSON_OK
+    // when all of data is used, or an error code.
+    template <typename Handler>
+    int feed(std::string_view data, Handler &&on_object)
+    {
+        while (!data.empty())
+        {
+            std::size_t used = 0;
+            int ret = emJSON_stream_feed(&stream_, data.data(), data.size(), &used);
+            data.remove_prefix(used);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            if (1 == ret)
+            {
+                on_object(object(emJSON_stream_take(&stream_)));
+            }
+        }
+        return JSON_OK;
+    }
+
+    // The end of the input. JSON_ERROR if it ended inside an object.
+    int end() noexcept { return emJSON_stream_end(&stream_); }
+
+private:
+    emJSON_stream_t stream_;
+};
+
+/*
+ * Struct binding. Specialize binding<T> with the fields of T:
+ *   template <> struct json::binding<sensor>
+ *   {
+ *       static constexpr auto fields = std::make_tuple(
+ *               json::field("id", &sensor::id), json::field("name", &sensor::name));
+ *   };
+ * Signed integer fields of up to 32 bits are ints of JSON, float ones
+ * numbers, char arrays strings and structs with a binding objects. Others do
+ * not compile, int64_t and double too, as numbers are int32_t and floats.
+ */
+template <typename T>
+struct binding;
+
+namespace detail
+{
+
+template <typename T, typename M>
+struct field_ref
+{
+    std::string_view key;
+    M T::*member;
+};
+
+}  // namespace detail
+
+template <typename T, typename M>
+constexpr detail::field_ref<T, M> field(std::string_view key, M T::*member) noexcept
+{
+    return detail::field_ref<T, M>{key, member};
+}
+
+template <typename T>
+const json_desc_t &descriptor();
+
+namespace detail
+{
+
+template <typename T>
+inline constexpr bool always_false = false;
+
+template <typename T, typename M>
+json_field_t make_field(const T &probe, const field_ref<T, M> &ref)
+{
+    json_field_t field{};
+    field.key = ref.key.data();
+    field.key_len = ref.key.size();
+    field.offset = static_cast<std::size_t>(reinterpret_cast<const char *>(&(probe.*ref.member)) -
+            reinterpret_cast<const char *>(&probe));
+    field.size = sizeof(M);
+    if constexpr (std::is_same_v<M, bool>)
+    {
+        static_assert(always_false<M>, "emJSON has no booleans");
+    }
+    else if constexpr (std::is_integral_v<M>)
+    {
+        static_assert(std::is_signed_v<M> && sizeof(M) <= sizeof(std::int32_t),
+                "numbers are int32_t: signed integers of up to 32 bits");
+        field.type = JSON_INT;
+    }
+    else if constexpr (std::is_floating_point_v<M>)
+    {
+        static_assert(std::is_same_v<M, float>, "numbers are floats: no double fields");
+        field.type = JSON_FLOAT;
+    }
+    else if constexpr (std::is_array_v<M>)
+    {
+        static_assert(std::is_same_v<std::remove_extent_t<M>, char>, "strings are char arrays");
+        field.type = JSON_STRING;
+    }
+    else
+    {
+        field.type = JSON_OBJECT;
+        field.desc = &descriptor<M>();
+    }
+    return field;
+}
+
+}  // namespace detail
+
+// The descriptor of T for the C functions, built once from binding<T>.
+template <typename T>
+const json_desc_t &descriptor()
+{
+    static_assert(std::is_standard_layout_v<T>, "fields are found by offsets");
+    static const auto fields = std::apply(
+            [](const auto &...refs) {
+                const T probe{};
+                return std::array<json_field_t, sizeof...(refs)>{detail::make_field(probe, refs)...};
+            },
+            binding<T>::fields);
+    static const json_desc_t desc = {fields.data(), fields.size()};
+    return desc;
+}
+
+// Parse input into dest. Returns as json_parse_into().
+template <typename T>
+int parse_into(T &dest, const char *input)
+{
+    return json_parse_into(&dest, &descriptor<T>(), input);
+}
+
+// Write src into dest of size bytes. Returns the length of the output.
+template <typename T>
+int write_from(const T &src, char *dest, std::size_t size)
+{
+    json_out_t out = {dest, size, 0, nullptr};
+    return json_write_from(&src, &descriptor<T>(), &out);
+}
+
+}  // namespace json
+
+#endif  // __EMJSON_HPP__
@@ -0,0 +1,102 @@
+#ifndef __EMJSON_ASYNC_HPP__
+#define __EMJSON_ASYNC_HPP__
+
+/*
+ * C++20 coroutines over json::stream, so that one thread can read objects
+ * from many slow sources, such as sockets in an epoll loop. Between reads a
+ * source keeps only its coroutine and the json::stream: the bytes read are
+ * parsed before the next read, so one read buffer can serve every source.
+ */
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include "emjson.hpp"
+
+namespace json
+{
+
+/*
+ * Coroutine of parse_stream(). It runs until its source has no bytes ready,
+ * and is resumed by whatever the source waits with. It is destroyed with the
+ * task.
+ */
+class task
+{
+public:
+    struct promise_type
+    {
+        int status = JSON_OK;
+
+        task get_return_object() noexcept
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(int ret) noexcept { status = ret; }
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    // No coroutine, until one is moved in.
+    task() noexcept = default;
+    task(task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    task &operator=(task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    ~task() { reset(); }
+
+    bool done() const noexcept { return handle_.done(); }
+    // What parse_stream() returned, once it is done.
+    int status() const noexcept { return handle_.promise().status; }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+    void reset() noexcept
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_{};
+};
+
+/*
+ * Parse the objects of source, giving each one to on_object as a
+ * json::object. co_await source.read() gives the next bytes as a
+ * std::string_view, which must stay valid until the next read; an empty one
+ * is the end. Returns JSON_OK at the end, JSON_ERROR if it was inside an
+ * object, or the error code of the parser.
+ */
+template <typename Source, typename Handler>
+task parse_stream(Source &source, Handler on_object)
+{
+    stream parser;
+    while (true)
+    {
+        std::string_view data = co_await source.read();
+        if (data.empty())
+        {
+            co_return parser.end();
+        }
+        int ret = parser.feed(data, on_object);
+        if (JSON_OK != ret)
+        {
+            co_return ret;
+        }
+    }
+}
+
+}  // namespace json
+
+#endif  // __EMJSON_ASYNC_HPP__
@@ -13,9 +13,35 @@ struct result_
 	size_t idx;
 };
 
+static json_t init_header_(void *buffer, size_t buf_size, size_t table_size);
 static int get_idx_(json_t *obj, char *key);
-static struct result_ insert_(json_t *obj, char *key, void *value, size_t size, json_type_t type);
-static void table_move_ptr_ (void *dest, void *source, json_t *obj);
+static int find_idx_(json_t *obj, int32_t hash);
+static int set_at_(json_t *obj, int idx, void *value);
+static struct result_ insert_(json_t *obj, char *key, void *value, size_t size, json_type_t type,
+        uint8_t flags);
+static struct result_ put_(json_t *obj, char *key, size_t key_len, void *value, size_t size,
+        json_type_t type, uint8_t flags);
+static size_t item_size_(const json_member_t *item);
+static int reinsert_(json_t *obj, struct entry_ *entry);
+static int by_place_(const void *a, const void *b);
+static size_t reinsert_size_(json_t *obj);
+static void table_move_ptr_ (void *dest, void *source, json_t *obj, int adopt);
+static void relink_(json_t *obj, void *old_buf);
+static void move_buffer_(json_t *obj, void *new_buf, size_t size, size_t dirty);
+static void rebase_free_lists_(json_t *obj, size_t offset);
+static void place_moving_(json_t *obj, size_t idx);
+static size_t compact_table_size_(size_t count);
+static int clone_into_(json_t *clone, json_t *obj);
+static void memory_stats_(json_t *obj, size_t depth, json_memory_stats_t *stats);
+static size_t probe_len_(json_t *obj, int32_t hash);
+static void *value_alloc_(json_t *obj, size_t *size);
+static void value_free_(json_t *obj, void *ptr, size_t size);
+static void str_len_update_(json_t *obj, size_t old_len, size_t new_len);
+static void mark_changed_(json_t *obj, struct entry_ *entry);
+static void set_value_(json_t *obj, struct entry_ *entry, const void *value);
+static int add_(json_t *obj, char *key, const void *value, json_type_t type);
+static int path_hash_(const char **pointer, int32_t *hash);
+static struct entry_ *path_entry_(json_t *obj, int32_t hash, uint32_t idx);
 
 /*******************************************************************************
  * Core Hash function
@@ -25,7 +51,7 @@ static void table_move_ptr_ (void *dest, void *source, json_t *obj);
  * Hash settings
  */
 
-// Hash functions
+// Hash functions. json::hash() of emjson.hpp is a constexpr copy of the default.
 #define EMJSON_HASH(hash, cha) EMJSON_JAVA_HASH(hash, cha)
     // 1000003 from python dictionary implementation,
     #define EMJSON_PYTHON_HASH(hash, cha)    ((1000003 * hash) ^ cha)
@@ -58,12 +84,30 @@ int32_t json_hash(char *str)
     return result;    
 }
 
+// json_hash() of len bytes, for keys that are not null-terminated.
+int32_t json_hash_n(const char *key, size_t len)
+{
+    int32_t result = EMJSON_HASH_START(*key);
+    for (size_t i = 0; i < len; i++)
+    {
+        char cha = key[i];
+        result = EMJSON_HASH(result, cha);
+    }
+    result ^= len;
+    return result;
+}
+
 /*******************************************************************************
  * lower-level basic functions
  ******************************************************************************/
 
 json_t json_init(void *buffer, size_t buf_size, size_t table_size)
 {
+    // The table is probed by masks of its size
+    if (0 == table_size || 0 != (table_size & (table_size - 1)))
+    {
+        return (json_t){0};
+    }
     // Check if the buffer size is enough
     if (buf_size < (sizeof(struct header_) + table_size * sizeof(struct entry_)))
     {
@@ -71,22 +115,15 @@ json_t json_init(void *buffer, size_t buf_size, size_t table_size)
     }
     // clear buffer
     memset(buffer, 0, buf_size);
-    json_t new_obj = { 
-        .buf = buffer
-    };
-    struct header_ *header = header_ptr_(&new_obj);
-    *header = (struct header_){
-    	.parent = NULL,
-        .buf_size = buf_size,
-        .buf_idx = sizeof(struct header_) + table_size * sizeof(struct entry_),
-        .table_size = table_size,
-        .entry_count = 0
-    };
-    return new_obj;
+    return init_header_(buffer, buf_size, table_size);
 }
 
 int json_delete(json_t *obj, char *key)
 {
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
     int idx = get_idx_(obj, key);
     if (idx < 0)
     {
@@ -99,6 +136,15 @@ int json_delete(json_t *obj, char *key)
     // erase selected entry in the replica and then replace it
     memset((table_ptr_(&tmp_obj) + idx), 0, sizeof(struct entry_));
 
+    // The entries go back in the order they are in the content, so that
+    // values take no more padding than they did; it is checked anyway, as
+    // strings may have been in freed slots.
+    qsort(table_ptr_(&tmp_obj), table_size_(&tmp_obj), sizeof(struct entry_), by_place_);
+    if (reinsert_size_(&tmp_obj) > buf_size_(obj))
+    {
+        return JSON_BUFFER_FULL;
+    }
+
     // Clear original table and replace it again
     json_clear(obj);
     
@@ -109,7 +155,7 @@ int json_delete(json_t *obj, char *key)
         {
             continue;
         }
-        json_insert(obj, entry->key, entry->value_ptr, entry->value_type);
+        reinsert_(obj, entry);
     }
     
     return JSON_OK;
@@ -117,13 +163,20 @@ int json_delete(json_t *obj, char *key)
 
 int json_clear(json_t *obj)
 {
-    // clear content
-    memset(content_ptr_(obj), 0, content_byte_size_(obj));
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    // clear content. Nothing after buf_idx has been written.
+    memset(content_ptr_(obj), 0, (uint8_t *)obj->buf + buf_idx_(obj) - (uint8_t *)content_ptr_(obj));
     buf_idx_(obj) = sizeof(struct header_) + table_size_(obj) * sizeof(struct entry_);
     
     // clear table
     memset(table_ptr_(obj), 0, table_byte_size_(obj));
     entry_count_(obj) = 0;
+    memset(free_list_(obj), 0, sizeof(free_list_(obj)));
+    str_len_update_(obj, str_len_(obj), 2);
+    mark_changed_(obj, NULL);
     return JSON_OK;
 }
 
@@ -150,63 +203,158 @@ int json_insert(json_t *obj, char *key, void *value, json_type_t type)
 
 int json_insert_int(json_t *obj, char *key, int32_t value)
 {    
-    return insert_(obj, key, &value, sizeof(int), JSON_INT).status;
+    return insert_(obj, key, &value, sizeof(int), JSON_INT, 0).status;
 }
 
 int json_insert_float(json_t *obj, char *key, float value)
 {    
-    return insert_(obj, key, &value, sizeof(float), JSON_FLOAT).status;
+    return insert_(obj, key, &value, sizeof(float), JSON_FLOAT, 0).status;
 }
 
 int json_insert_str(json_t *obj, char *key, char *value)
 {
-    // make temporary string. Length is multiples of 8.
-    int size = (((strlen(value) + 1) >> 3) + 1) << 3;
-    char str_tmp[size];
-    memset(str_tmp, 0, size);
-    strcpy(str_tmp, value);
-    
-    return insert_(obj, key, str_tmp, size, JSON_STRING).status;
+    // Length is multiples of 8. The slot is padded with zeros.
+    return insert_(obj, key, value, str_slot_size_(strlen(value)), JSON_STRING, 0).status;
 }
 
 
 int json_insert_obj(json_t *obj, char *key, json_t *input)
 {
 	// insert
-	struct result_ ret = insert_(obj, key, input->buf, buf_size_(input), JSON_OBJECT);
+	struct result_ ret = insert_(obj, key, input->buf, buf_size_(input), JSON_OBJECT, 0);
 	if (ret.status != JSON_OK)
 	{
 		return ret.status;
 	}
-	// move pointers
-	table_move_ptr_ (table_ptr_(obj)[ret.idx].value_ptr, input->buf, input);
-
-	// change input object and set parent
-	// FIXME: make the following line shorter
-	((struct header_ *)(table_ptr_(obj)[ret.idx].value_ptr))->parent_entry_idx = ret.idx;
+	// change input object to the copy and move its pointers
+	void *old_buf = input->buf;
 	input->buf = table_ptr_(obj)[ret.idx].value_ptr;
+	table_move_ptr_ (input->buf, old_buf, input, 1);
+
+	// set parent
+	idx_in_parent_(input) = ret.idx;
 	parent_ptr_(input) = obj->buf;
 	return ret.status;
 }
 
 
+/*
+ * Insert input by reference. The parent keeps a pointer to its buffer, not a
+ * copy, so that the child can grow or move on its own; tell the parent by
+ * json_replace_buffer() or json_relocate() on the child. Its buffer must live
+ * as long as obj.
+ */
+int json_link_obj(json_t *obj, char *key, json_t *input)
+{
+	struct result_ ret = insert_(obj, key, NULL, 0, JSON_NULL, 0);
+	if (ret.status != JSON_OK)
+	{
+		return ret.status;
+	}
+	struct entry_ *entry = table_ptr_(obj) + ret.idx;
+	entry->value_ptr = input->buf;
+	entry->value_type = JSON_OBJECT;
+	entry->flags |= ENTRY_LINKED_;
+
+	// set parent
+	idx_in_parent_(input) = ret.idx;
+	parent_ptr_(input) = obj->buf;
+	str_len_update_(obj, 4, str_len_(input));	// "null" to the object
+	return ret.status;
+}
+
+
 int json_insert_empty_obj(json_t *obj, char *key, size_t size)
 {
-	// insert
-	struct result_ ret = insert_(obj, key, NULL, size, JSON_NULL);
+	if (size < sizeof(struct header_) + 4 * sizeof(struct entry_))
+	{	// no room for the header and the table of the child
+		return JSON_BUFFER_FULL;
+	}
+	// insert, as null until it is set up
+	struct result_ ret = insert_(obj, key, NULL, size, JSON_OBJECT, 0);
 	if (ret.status != JSON_OK)
 	{
 		return ret.status;
 	}
-	// get object and init
-	json_t tmp = json_init(table_ptr_(obj)[ret.idx].value_ptr, size, 4);
+	// get object and init. It is after buf_idx, so it is zero already:
+	// clearing it again made parsing many nested objects quadratic.
+	json_t tmp = init_header_(table_ptr_(obj)[ret.idx].value_ptr, size, 4);
 	parent_ptr_(&tmp) = obj->buf;
 	table_ptr_(obj)[ret.idx].value_type = JSON_OBJECT;
-	((struct header_ *)(table_ptr_(obj)[ret.idx].value_ptr))->parent_entry_idx = ret.idx;
-	// TODO: what if the buffer is not enough?
+	idx_in_parent_(&tmp) = ret.idx;
+	str_len_update_(obj, 4, 2);	// "null" to "{}"
 	return ret.status;
 }
 
+/*
+ * Insert n members at once, as json_insert() would one by one. The room for
+ * all of them is checked first, so that nothing is inserted if the table or
+ * the buffer is too small. A key that is already there stops it, with the
+ * members before it inserted.
+ */
+int json_insert_batch(json_t *obj, const json_member_t *items, size_t n)
+{
+    size_t bytes;
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    if (JSON_OK != batch_bytes_(items, n, &bytes))
+    {
+        return JSON_ERROR;
+    }
+    if (entry_count_(obj) + n > table_size_(obj))
+    {
+        return JSON_TABLE_FULL;
+    }
+    if (buf_idx_(obj) + bytes > buf_size_(obj))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    size_t str_len = 0;
+    int ret = JSON_OK;
+    for (size_t k = 0; k < n && JSON_OK == ret; k++)
+    {
+        const json_member_t *item = items + k;
+        if (JSON_OBJECT == item->type)
+        {   // the input is changed to its copy
+            ret = json_insert_obj(obj, item->key, item->value);
+            continue;
+        }
+        size_t key_len = strlen(item->key);
+        struct result_ result = put_(obj, item->key, key_len, item->value, item_size_(item),
+                item->type, 0);
+        if (JSON_OK == result.status)
+        {
+            struct entry_ *entry = table_ptr_(obj) + result.idx;
+            str_len += (entry_count_(obj) > 1) + key_len + 3 +
+                    value_strlen_(entry->value_type, entry->value_ptr);
+        }
+        ret = result.status;
+    }
+    // once for all of them, up to the root
+    str_len_update_(obj, 0, str_len);
+    mark_changed_(obj, NULL);
+    return ret;
+}
+
+// Bytes of the buffer that json_insert_batch() takes at most.
+int batch_bytes_(const json_member_t *items, size_t n, size_t *bytes)
+{
+    *bytes = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        size_t size = item_size_(items + k);
+        if (0 == size)
+        {
+            return JSON_ERROR;
+        }
+        // with the most padding the value can take
+        *bytes += strlen(items[k].key) + 1 + (value_align_(items[k].type) - 1) + size;
+    }
+    return JSON_OK;
+}
+
 /*******************************************************************************
  * Getter functions
  ******************************************************************************/
@@ -245,6 +393,60 @@ float json_get_float(json_t *obj, char *key)
 #endif
 }
 
+/*
+ * Like json_get(), by the json_hash() of the key. Keys are told apart by
+ * their hashes, so this is the same lookup without hashing the key again.
+ */
+void *json_get_hashed(json_t *obj, int32_t hash, json_type_t type)
+{
+    int idx = find_idx_(obj, hash);
+    if (idx >= 0)
+    {
+        json_type_t target_type = table_ptr_(obj)[idx].value_type;
+        return (target_type == type && target_type != JSON_NULL)? table_ptr_(obj)[idx].value_ptr : NULL;
+    }
+    return NULL;
+}
+
+/*
+ * Look up n keys at once, into out. A key that is not there gets a NULL
+ * value and key. The keys are hashed and their first slots prefetched
+ * before any is looked up, and then their values, so that the cache misses
+ * of the keys overlap. Returns the number of keys found.
+ */
+size_t json_get_many(json_t *obj, char **keys, size_t n, json_member_t *out)
+{
+    int32_t hash[JSON_GET_MANY_BATCH];
+    size_t mask = table_size_(obj) - 1;
+    size_t found = 0;
+    for (size_t start = 0; start < n; start += JSON_GET_MANY_BATCH)
+    {
+        size_t count = (n - start < JSON_GET_MANY_BATCH) ? n - start : JSON_GET_MANY_BATCH;
+        for (size_t k = 0; k < count; k++)
+        {
+            hash[k] = json_hash(keys[start + k]);
+            prefetch_(table_ptr_(obj) + (hash[k] & mask));
+        }
+        for (size_t k = 0; k < count; k++)
+        {
+            json_member_t *member = out + start + k;
+            int idx = find_idx_(obj, hash[k]);
+            if (idx < 0)
+            {
+                *member = (json_member_t){0};
+                continue;
+            }
+            struct entry_ *entry = table_ptr_(obj) + idx;
+            prefetch_(entry->value_ptr);
+            member->key = entry->key;
+            member->value = entry->value_ptr;
+            member->type = entry->value_type;
+            found += 1;
+        }
+    }
+    return found;
+}
+
 char *json_get_str(json_t *obj, char *key)
 {
     return (char *)json_get(obj, key, JSON_STRING);
@@ -259,41 +461,179 @@ json_t json_get_obj(json_t *obj, char *key)
 }
 
 /*******************************************************************************
- * Setter functions
+ * Path lookup
  ******************************************************************************/
 
-int json_set(json_t *obj, char *key, void *value)
+/*
+ * Like json_get(), by a JSON Pointer (RFC 6901) such as "/a/b/c", where "~0"
+ * is '~' and "~1" is '/'. "" is obj itself, as a JSON_OBJECT.
+ */
+void *json_get_path(json_t *obj, const char *pointer, json_type_t type)
 {
-    int idx = get_idx_(obj, key);
-    if (idx >= 0)
+    json_t cur = *obj;
+    struct entry_ *entry = NULL;
+    if ('\0' == *pointer)
     {
-        struct entry_ *entry = table_ptr_(obj) + idx;
-        memcpy(entry->value_ptr, value, entry->value_size);
-        return JSON_OK;
+        return (JSON_OBJECT == type) ? obj->buf : NULL;
     }
-    return JSON_ERROR;
+    while ('\0' != *pointer)
+    {
+        int32_t hash;
+        if (NULL != entry)
+        {
+            if (JSON_OBJECT != entry->value_type)
+            {
+                return NULL;
+            }
+            cur.buf = entry->value_ptr;
+        }
+        if (JSON_OK != path_hash_(&pointer, &hash))
+        {
+            return NULL;
+        }
+        int idx = find_idx_(&cur, hash);
+        if (idx < 0)
+        {
+            return NULL;
+        }
+        entry = table_ptr_(&cur) + idx;
+    }
+    return (entry->value_type == type && type != JSON_NULL) ? entry->value_ptr : NULL;
+}
+
+/*
+ * Hash each level of pointer once, for json_path_get(). Returns JSON_ERROR
+ * if it is not a pointer or has more than JSON_PATH_DEPTH levels.
+ */
+int json_path_compile(json_path_t *path, const char *pointer)
+{
+    path->depth = 0;
+    while ('\0' != *pointer)
+    {
+        if (JSON_PATH_DEPTH == path->depth ||
+            JSON_OK != path_hash_(&pointer, &path->hash[path->depth]))
+        {
+            path->depth = 0;
+            return JSON_ERROR;
+        }
+        path->idx[path->depth] = UINT32_MAX;
+        path->depth += 1;
+    }
+    return JSON_OK;
+}
+
+/*
+ * Store the table index of each level in obj, so that json_path_get() goes
+ * straight to it. They stay right while the tables of obj do not change, as
+ * in a frozen object; a wrong one only costs a lookup.
+ */
+int json_path_resolve(json_path_t *path, json_t *obj)
+{
+    json_t cur = *obj;
+    for (size_t level = 0; level < path->depth; level++)
+    {
+        int idx = find_idx_(&cur, path->hash[level]);
+        if (idx < 0)
+        {
+            return JSON_NO_MATCHED_KEY;
+        }
+        struct entry_ *entry = table_ptr_(&cur) + idx;
+        if (level + 1 < path->depth && JSON_OBJECT != entry->value_type)
+        {
+            return JSON_TYPE_MISMATCH;
+        }
+        path->idx[level] = idx;
+        cur.buf = entry->value_ptr;
+    }
+    return JSON_OK;
+}
+
+// Like json_get_path(), by a compiled path. path is only read.
+void *json_path_get(const json_path_t *path, json_t *obj, json_type_t type)
+{
+    json_t cur = *obj;
+    struct entry_ *entry = NULL;
+    if (0 == path->depth)
+    {
+        return (JSON_OBJECT == type) ? obj->buf : NULL;
+    }
+    for (size_t level = 0; level < path->depth; level++)
+    {
+        if (NULL != entry)
+        {
+            if (JSON_OBJECT != entry->value_type)
+            {
+                return NULL;
+            }
+            cur.buf = entry->value_ptr;
+        }
+        entry = path_entry_(&cur, path->hash[level], path->idx[level]);
+        if (NULL == entry)
+        {
+            return NULL;
+        }
+    }
+    return (entry->value_type == type && type != JSON_NULL) ? entry->value_ptr : NULL;
+}
+
+/*******************************************************************************
+ * Setter functions
+ ******************************************************************************/
+
+int json_set(json_t *obj, char *key, void *value)
+{
+    return set_at_(obj, get_idx_(obj, key), value);
+}
+
+// Like json_set(), by the json_hash() of the key.
+int json_set_hashed(json_t *obj, int32_t hash, void *value)
+{
+    return set_at_(obj, find_idx_(obj, hash), value);
 }
 
 int json_set_str(json_t *obj, char *key, char *value)
 {
-    // make temporary string. Length is multiples of 8.
-    size_t size = (((strlen(value) + 1) >> 3) + 1) << 3;
-    char str_tmp[size];
-    memset(str_tmp, 0, size);
-    strcpy(str_tmp, value);
-    
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
     int idx = get_idx_(obj, key);
-    if (idx >= 0)
+    if (idx < 0)
     {
-        struct entry_ *entry = table_ptr_(obj) + idx;
-        if (size > entry->value_size)
+        return JSON_ERROR;
+    }
+    struct entry_ *entry = table_ptr_(obj) + idx;
+    if (JSON_STRING != entry->value_type && JSON_NULL != entry->value_type)
+    {
+        return JSON_TYPE_MISMATCH;
+    }
+    size_t old_len = value_strlen_(entry->value_type, entry->value_ptr);
+    size_t len = strlen(value) + 1;
+    int is_borrowed = entry->flags & ENTRY_VALUE_BORROWED_;
+    if (len > entry->value_size || is_borrowed)
+    {
+        // Move the value to a bigger slot. Take a freed one first,
+        // append one only when nothing fits.
+        size_t size = str_slot_size_(len - 1);
+        void *value_ptr = value_alloc_(obj, &size);
+        if (NULL == value_ptr)
         {
-            return JSON_ENTRY_BUFFER_FULL;
+            return JSON_BUFFER_FULL;
         }
-        memcpy(entry->value_ptr, value, entry->value_size);
-        return JSON_OK;
+        if (!is_borrowed)
+        {   // the input is not ours
+            value_free_(obj, entry->value_ptr, entry->value_size);
+        }
+        entry->value_ptr = value_ptr;
+        entry->value_size = size;
+        entry->flags &= ~ENTRY_VALUE_BORROWED_;
     }
-    return JSON_ERROR;
+    memcpy(entry->value_ptr, value, len);
+    memset(entry->value_ptr + len, 0, entry->value_size - len);
+    entry->value_type = JSON_STRING;
+    str_len_update_(obj, old_len, len + 1);	// quoted
+    mark_changed_(obj, entry);
+    return JSON_OK;
 }
 
 int json_set_int(json_t *obj, char *key, int value)
@@ -306,57 +646,116 @@ int json_set_float(json_t *obj, char *key, float value)
     return json_set(obj, key, &value);
 }
 
+/*
+ * Add value to a number. On an object made by json_make_concurrent() it is
+ * done at once, so threads can count without locks.
+ */
+int json_add_int(json_t *obj, char *key, int32_t value)
+{
+    return add_(obj, key, &value, JSON_INT);
+}
+
+int json_add_float(json_t *obj, char *key, float value)
+{
+    return add_(obj, key, &value, JSON_FLOAT);
+}
+
+int json_increment(json_t *obj, char *key)
+{
+    return json_add_int(obj, key, 1);
+}
+
 /*******************************************************************************
  * Buffer and memory management functions
  ******************************************************************************/
 
 int json_replace_buffer(json_t *obj, void *new_buf, size_t size)
 {
-    void *old_buf = obj->buf;
-
-    table_move_ptr_ (new_buf, old_buf, obj);
-
-    // clear buffer first then copy
-    memset(new_buf, 0, size);
-    memcpy(new_buf, old_buf, buf_idx_(obj));
-    
-    // move pointers
-    obj->buf = new_buf;
-    
-    // Confirm
-    buf_size_(obj) = size;
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    move_buffer_(obj, new_buf, size, size);
     return JSON_OK;
 }
 
 
 int json_double_table(json_t *obj)
 {
+    return resize_table_(obj, table_size_(obj) * 2);
+}
+
+// Grow the table to table_size slots, a power of two, in one step.
+int resize_table_(json_t *obj, size_t table_size)
+{
+    size_t added = (table_size - table_size_(obj)) * sizeof(struct entry_);
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
     // Check if the buffer is big enough
-    if (buf_size_(obj) - buf_idx_(obj) < table_byte_size_(obj))
+    if (buf_size_(obj) - buf_idx_(obj) < added)
     {
         return JSON_BUFFER_FULL;
     }
-    // create a temp JSON object
-    uint8_t tmp_buf[buf_size_(obj)];
-    json_t tmp_obj = json_init(tmp_buf, buf_size_(obj), table_size_(obj) * 2);
-    
-    for (size_t i = 0; i < table_size_(obj); i++)
+    if (buf_idx_(obj) == sizeof(struct header_) + table_byte_size_(obj))
+    {   // nothing in it, as when a parse starts again: all is zero after the header
+        table_size_(obj) = table_size;
+        buf_idx_(obj) = sizeof(struct header_) + table_byte_size_(obj);
+        return JSON_OK;
+    }
+    // The content is moved up for the bigger table, in place, so that no
+    // copy of the object is needed: it may be bigger than the stack.
+    uint8_t *table = (uint8_t *)table_ptr_(obj);
+    size_t table_bytes = table_byte_size_(obj);
+    memmove(table + table_bytes + added, table + table_bytes,
+            buf_idx_(obj) - sizeof(struct header_) - table_bytes);
+    table_move_ptr_ (obj->buf + added, obj->buf, obj, 1);
+    rebase_free_lists_(obj, added);
+
+    // The entries are packed at the end of the new table, from the back, as
+    // none is written over before it is read, and then placed.
+    size_t moving = table_size;
+    for (size_t i = table_size_(obj); i-- > 0;)
     {
-        struct entry_ *entry = (table_ptr_(obj) + i);
-        if (NULL == entry->key)
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL != entry->key)
         {
-            continue;
+            moving -= 1;
+            memmove(table_ptr_(obj) + moving, entry, sizeof(struct entry_));
+            table_ptr_(obj)[moving].flags |= ENTRY_MOVING_;
         }
-        json_insert(&tmp_obj, entry->key, entry->value_ptr, entry->value_type);
     }
-    // Then replace buffer
-    json_replace_buffer(&tmp_obj, obj->buf, buf_size_(obj));
-    
-    // Then replace table
-    obj->buf = tmp_obj.buf;
+    memset(table, 0, moving * sizeof(struct entry_));
+    table_size_(obj) = table_size;
+    for (size_t i = moving; i < table_size; i++)
+    {
+        if (table_ptr_(obj)[i].flags & ENTRY_MOVING_)
+        {
+            place_moving_(obj, i);
+        }
+    }
+    buf_idx_(obj) += added;
+    header_flags_(obj) |= HEADER_LAYOUT_CHANGED_;	// the entries have other indices
+    return JSON_OK;
+}
+
+/*
+ * Fix the pointers of an object after its buffer has been moved or copied
+ * from old_buf to obj->buf by other means, like realloc() or mmap().
+ * A child moved out of its parent is linked to the new place.
+ */
+int json_relocate(json_t *obj, void *old_buf)
+{
+    if (obj->buf != old_buf)
+    {
+        table_move_ptr_ (obj->buf, old_buf, obj, 1);
+        relink_(obj, old_buf);
+    }
     return JSON_OK;
 }
 
+// Linked children are shared with obj, not copied.
 json_t json_copy(void *dest_buf, json_t *obj)
 {
     memcpy(dest_buf, obj->buf, buf_size_(obj));
@@ -364,17 +763,75 @@ json_t json_copy(void *dest_buf, json_t *obj)
         .buf = dest_buf
     };
 
-    table_move_ptr_ (dest_buf, obj->buf, &new_obj);
+    table_move_ptr_ (dest_buf, obj->buf, &new_obj, 0);
     return new_obj;
 }
 
-/*******************************************************************************
- * Other utility functions
- ******************************************************************************/
-
-size_t json_table_size(json_t *obj)
+// Size of the buffer json_clone_compact() needs for obj.
+size_t json_compact_size(json_t *obj)
 {
-    return table_size_(obj);
+    size_t size = sizeof(struct header_) +
+            compact_table_size_(entry_count_(obj)) * sizeof(struct entry_);
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        size += strlen(entry->key) + 1 + (value_align_(entry->value_type) - 1);
+        switch (entry->value_type)
+        {
+        case JSON_INT:
+        case JSON_FLOAT:
+            size += sizeof(int32_t);
+            break;
+        case JSON_STRING:
+            size += strlen(entry->value_ptr) + 1;
+            break;
+        case JSON_OBJECT:
+            {
+                json_t child = {
+                        .buf = entry->value_ptr
+                };
+                size += json_compact_size(&child);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return size;
+}
+
+/*
+ * Copy obj into dest with no free space: the table as small as the entries
+ * allow, strings without slot padding, and nested objects, linked or not,
+ * packed into the same buffer. The copy is a root object. Returns an object
+ * with a NULL buffer if cap is less than json_compact_size().
+ */
+json_t json_clone_compact(void *dest, size_t cap, json_t *obj)
+{
+    size_t size = json_compact_size(obj);
+    if (cap < size)
+    {
+        return (json_t){0};
+    }
+    json_t clone = json_init(dest, size, compact_table_size_(entry_count_(obj)));
+    if (JSON_OK != clone_into_(&clone, obj))
+    {
+        return (json_t){0};
+    }
+    return clone;
+}
+
+/*******************************************************************************
+ * Other utility functions
+ ******************************************************************************/
+
+size_t json_table_size(json_t *obj)
+{
+    return table_size_(obj);
 }
 
 size_t json_count(json_t *obj)
@@ -382,11 +839,231 @@ size_t json_count(json_t *obj)
     return entry_count_(obj);
 }
 
+/*
+ * Go through the members of obj: start with *idx at 0, then each call
+ * fills member and returns 1, until it returns 0 at the end. obj must not
+ * be changed in between.
+ */
+int json_next(json_t *obj, size_t *idx, json_member_t *member)
+{
+    for (; *idx < table_size_(obj); *idx += 1)
+    {
+        struct entry_ *entry = table_ptr_(obj) + *idx;
+        if (NULL != entry->key)
+        {
+            *member = (json_member_t){
+                .key = entry->key,
+                .value = entry->value_ptr,
+                .type = entry->value_type
+            };
+            *idx += 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 size_t json_buffer_size(json_t *obj)
 {
     return buf_size_(obj);
 }
 
+/*
+ * Make obj and its children read-only. The functions changing them return
+ * JSON_FROZEN from now on. Lookups and serialization write nothing, so a
+ * frozen object can be read by many threads at once.
+ */
+int json_freeze(json_t *obj)
+{
+    // Changes not written yet are kept, so that a cached write still has
+    // them; other flags, like the concurrent one, are kept as well.
+    header_flags_(obj) |= HEADER_FROZEN_;
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL != entry->key && JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            json_freeze(&child);
+        }
+    }
+    return JSON_OK;
+}
+
+int json_is_frozen(json_t *obj)
+{
+    return is_frozen_(obj) ? 1 : 0;
+}
+
+// Where the memory of obj goes, including its nested objects.
+int json_memory_stats(json_t *obj, json_memory_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->buffer_bytes = buf_size_(obj);
+    memory_stats_(obj, 0, stats);
+    if (stats->slot_count > 0)
+    {
+        stats->load_factor = (float)stats->entry_count / stats->slot_count;
+    }
+    if (stats->entry_count > 0)
+    {   // avg_probe holds the sum until here
+        stats->avg_probe = stats->avg_probe / stats->entry_count;
+    }
+    return JSON_OK;
+}
+
+
+/*******************************************************************************
+ * Joining parts of an object
+ ******************************************************************************/
+
+/*
+ * An object parsed in parts, each of some of its members, is joined into
+ * one by emJSON_parse_parallel(): the contents of the parts are copied one
+ * after another, and their entries are put into one table.
+ */
+
+/*
+ * Bytes the content of part takes in the joined object. Each part starts at
+ * a word, so that its values stay aligned.
+ */
+size_t join_offset_(json_t *part)
+{
+    return (content_used_(part) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+}
+
+// Size of the buffer the joined object needs.
+size_t join_size_(json_t *part, size_t count)
+{
+    size_t entry_count = 0;
+    size_t content_size = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        entry_count += entry_count_(part + k);
+        content_size += join_offset_(part + k);
+    }
+    return sizeof(struct header_) + compact_table_size_(entry_count) * sizeof(struct entry_) +
+            content_size;
+}
+
+// Lay out obj, which must be empty, with the table and content of the parts.
+int join_init_(json_t *obj, json_t *part, size_t count)
+{
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    if (0 != entry_count_(obj))
+    {
+        return JSON_ERROR;
+    }
+    size_t size = join_size_(part, count);
+    if (size > buf_size_(obj))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    // An empty object is zero from its table on.
+    size_t entry_count = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        entry_count += entry_count_(part + k);
+    }
+    table_size_(obj) = compact_table_size_(entry_count);
+    buf_idx_(obj) = size;
+    memset(free_list_(obj), 0, sizeof(free_list_(obj)));
+    return JSON_OK;
+}
+
+/*
+ * Copy the content of part to offset in the content of obj, and move the
+ * pointers of the children in it. Parts can be copied at the same time.
+ */
+void join_copy_(json_t *obj, json_t *part, size_t offset)
+{
+    void *dest = content_ptr_(obj) + offset;
+    void *source = content_ptr_(part);
+    memcpy(dest, source, content_used_(part));
+    for (size_t i = 0; i < table_size_(part); i++)
+    {
+        struct entry_ *entry = table_ptr_(part) + i;
+        if (NULL == entry->key || JSON_OBJECT != entry->value_type ||
+            (entry->flags & ENTRY_LINKED_))
+        {
+            continue;
+        }
+        json_t child = {
+                .buf = dest + (entry->value_ptr - source)
+        };
+        table_move_ptr_ (dest, source, &child, 1);
+    }
+}
+
+/*
+ * Put the entries of the parts, copied by join_copy_(), into the table of
+ * obj. The same key in two parts is JSON_KEY_EXISTS.
+ */
+int join_table_(json_t *obj, json_t *part, size_t count)
+{
+    size_t str_len = 2;	// "{}"
+    size_t joined = 0;	// parts with entries
+    void *dest = content_ptr_(obj);
+    for (size_t k = 0; k < count; k++)
+    {
+        void *source = content_ptr_(part + k);
+        for (size_t i = 0; i < table_size_(part + k); i++)
+        {
+            struct entry_ entry = table_ptr_(part + k)[i];
+            if (NULL == entry.key)
+            {
+                continue;
+            }
+            // the same place in the copied content
+            if (!(entry.flags & ENTRY_KEY_BORROWED_))
+            {
+                entry.key = (char *)dest + (entry.key - (char *)source);
+            }
+            if (!(entry.flags & (ENTRY_LINKED_ | ENTRY_VALUE_BORROWED_)))
+            {
+                entry.value_ptr = dest + (entry.value_ptr - source);
+            }
+            // the hash is known, so it goes straight into the table
+            size_t idx = entry.hash & (table_size_(obj) - 1);
+            uint32_t perturb = entry.hash;
+            while (NULL != table_ptr_(obj)[idx].key)
+            {
+                if (entry.hash == table_ptr_(obj)[idx].hash)
+                {
+                    return JSON_KEY_EXISTS;
+                }
+                idx = (5 * idx) + 1 + perturb;
+                perturb >>= PERTURB_SHIFT;
+                idx = idx & (table_size_(obj) - 1);
+            }
+            if (JSON_OBJECT == entry.value_type)
+            {
+                json_t child = {
+                        .buf = entry.value_ptr
+                };
+                parent_ptr_(&child) = obj->buf;
+                idx_in_parent_(&child) = idx;
+            }
+            table_ptr_(obj)[idx] = entry;
+            entry_count_(obj) += 1;
+        }
+        if (entry_count_(part + k) > 0)
+        {   // the members between the braces, and a ',' before them but the first
+            str_len += (str_len_(part + k) - 2) + (joined > 0);
+            joined += 1;
+        }
+        dest += join_offset_(part + k);
+    }
+    str_len_update_(obj, str_len_(obj), str_len);
+    mark_changed_(obj, NULL);
+    return JSON_OK;
+}
+
 
 /*******************************************************************************
  * Debug functions
@@ -498,97 +1175,202 @@ void json_debug_print_obj(json_t *obj)
     JSON_DEBUG_PRINTF("\t End printing\n");
     JSON_DEBUG_PRINTF("==========================\n");
     return;
-#endif
 }
+#endif
 
 /*******************************************************************************
  * Private functions
  ******************************************************************************/
 
+// The header of an empty object in a buffer which is zero.
+static json_t init_header_(void *buffer, size_t buf_size, size_t table_size)
+{
+    json_t new_obj = {
+        .buf = buffer
+    };
+    struct header_ *header = header_ptr_(&new_obj);
+    *header = (struct header_){
+    	.parent = NULL,
+        .buf_size = buf_size,
+        .buf_idx = sizeof(struct header_) + table_size * sizeof(struct entry_),
+        .table_size = table_size,
+        .entry_count = 0,
+        .str_len = 2	// "{}"
+    };
+    return new_obj;
+}
+
 static int get_idx_(json_t *obj, char *key)
 {
-    int32_t hash = json_hash(key);
+    return find_idx_(obj, json_hash(key));
+}
+
+static int find_idx_(json_t *obj, int32_t hash)
+{
     size_t idx = hash & (table_size_(obj) - 1);
-    struct entry_ entry;
     
     // variables for open addressing
-    int perturb = hash;
-    uint8_t checked[table_size_(obj)];
-    size_t count = 0;
-    
-    // Search start
-    entry = table_ptr_(obj)[idx];
-    if (hash == entry.hash)
-    {   // Good
-        goto end_success;
-    }
+    uint32_t perturb = hash;	// unsigned, so that it runs out to 0
+    // Once perturb is 0, the sequence visits every slot in table_size steps,
+    // so this many probes cover the table. No scratch, so lookups can run
+    // in many threads at once.
+    size_t probe_limit = table_size_(obj) + (32 / PERTURB_SHIFT) + 1;
     
-    // On collision
-    memset(checked, 0, table_size_(obj));
-    while (hash != entry.hash)
+    for (size_t count = 0; count < probe_limit; count++)
     {
-        if (0 == checked[idx])
+        struct entry_ *entry = table_ptr_(obj) + idx;
+        if (hash == entry->hash && NULL != entry->key)
         {
-        	checked[idx] += 1;
-            count++;
-            if (count >= table_size_(obj))
-            {   // When the table is full and visited all entries
-                goto end_error;
-            }
+            return idx;
         }
-        if (NULL == entry.key)
+        if (NULL == entry->key)
         {   // When we get empty slot
-            goto end_error;
+            return JSON_NO_MATCHED_KEY;
         }
         // open addressing
         idx = (5 * idx) + 1 + perturb;
         perturb >>= PERTURB_SHIFT;
         idx = idx & (table_size_(obj) - 1);
-        // refresh
-        entry = table_ptr_(obj)[idx];
     }
-end_success:
-    return idx;
-end_error:
+    // When the table is full and visited all entries
     return JSON_NO_MATCHED_KEY;
 }
 
+/*
+ * Hash the reference token of pointer, which is at its '/', as json_hash()
+ * hashes the key it stands for. pointer is moved past it.
+ */
+static int path_hash_(const char **pointer, int32_t *hash)
+{
+    const char *i = *pointer;
+    if (*i != '/')
+    {
+        return JSON_ERROR;
+    }
+    i += 1;
+    // without escapes, the key is as it is
+    const char *end = i;
+    int32_t result = EMJSON_HASH_START(*i);
+    for (; *end != '\0' && *end != '/' && *end != '~'; end++)
+    {
+        char cha = *end;
+        result = EMJSON_HASH(result, cha);
+    }
+    if (*end != '~')
+    {
+        result ^= (end - i);
+        *hash = result;
+        *pointer = end;
+        return JSON_OK;
+    }
+    size_t len = 0;
+    for (; *i != '\0' && *i != '/'; i++)
+    {
+        char cha = *i;
+        if (cha == '~')
+        {   // "~0" is '~' and "~1" is '/'
+            i += 1;
+            if (*i != '0' && *i != '1')
+            {
+                return JSON_ERROR;
+            }
+            cha = (*i == '0') ? '~' : '/';
+        }
+        if (0 == len)
+        {
+            result = EMJSON_HASH_START(cha);
+        }
+        result = EMJSON_HASH(result, cha);
+        len += 1;
+    }
+    result ^= len;
+    *hash = result;
+    *pointer = i;
+    return JSON_OK;
+}
+
+// The entry of hash, at idx if it is still there.
+static struct entry_ *path_entry_(json_t *obj, int32_t hash, uint32_t idx)
+{
+    if (idx < table_size_(obj))
+    {
+        struct entry_ *entry = table_ptr_(obj) + idx;
+        if (hash == entry->hash && NULL != entry->key)
+        {
+            return entry;
+        }
+    }
+    int found = find_idx_(obj, hash);
+    return (found >= 0) ? table_ptr_(obj) + found : NULL;
+}
+
 
-static struct result_ insert_(json_t *obj, char *key, void *value, size_t size, json_type_t type)
+static struct result_ insert_(json_t *obj, char *key, void *value, size_t size, json_type_t type,
+        uint8_t flags)
 {
 	struct result_ ret = {
 			.status = JSON_ERROR,
 			.idx = 0
 	};
+    if (is_frozen_(obj))
+    {
+        ret.status = JSON_FROZEN;
+        return ret;
+    }
     if (entry_count_(obj) >= table_size_(obj))
     {
     	ret.status = JSON_TABLE_FULL;
         return ret;
     }
     
-    // buffer size check
-    size_t key_size = strlen(key) + 1;
+    // buffer size check. Borrowed ones take no space.
+    size_t key_len = strlen(key);
+    size_t key_size = (flags & ENTRY_KEY_BORROWED_) ? 0 : key_len + 1;
     size_t value_size = size;
-    size_t buf_required = key_size + value_size;
+    size_t buf_required = key_size + ((flags & ENTRY_VALUE_BORROWED_) ? 0 :
+            value_pad_(buf_idx_(obj) + key_size, type) + value_size);
     if (buf_idx_(obj) + buf_required > buf_size_(obj))
     {
     	ret.status = JSON_BUFFER_FULL;
         return ret;
     }
     
+    ret = put_(obj, key, key_len, value, size, type, flags);
+    if (JSON_OK == ret.status)
+    {
+        struct entry_ *entry = table_ptr_(obj) + ret.idx;
+        // ,"<key>":<value>
+        str_len_update_(obj, 0, (entry_count_(obj) > 1) + key_len + 3 +
+                value_strlen_(entry->value_type, entry->value_ptr));
+        mark_changed_(obj, NULL);
+    }
+    return ret;
+}
+
+/*
+ * Put an entry into a table that has room for it, and its key and value
+ * into the buffer. The lengths of the object are left to the caller.
+ */
+static struct result_ put_(json_t *obj, char *key, size_t key_len, void *value, size_t size,
+        json_type_t type, uint8_t flags)
+{
+	struct result_ ret = {
+			.status = JSON_KEY_EXISTS,
+			.idx = 0
+	};
+    size_t value_size = size;
     // construct entry object first, with hash.
     struct entry_ new_entry = {0};
-    new_entry.hash = json_hash(key);
+    new_entry.hash = json_hash_n(key, key_len);
     
     // put into the table
     int32_t new_idx = new_entry.hash & (table_size_(obj) - 1);
     
-    int perturb = new_entry.hash;
+    uint32_t perturb = new_entry.hash;
     while (NULL != (table_ptr_(obj)[new_idx].key))
     {    // collision, open addressing
         if (new_entry.hash == table_ptr_(obj)[new_idx].hash)
         {    // collision, and the hash are the same (same key)
-        	ret.status = JSON_KEY_EXISTS;
             return ret;
         }
         new_idx = (new_idx << 2) + new_idx + 1 + perturb;
@@ -597,25 +1379,48 @@ static struct result_ insert_(json_t *obj, char *key, void *value, size_t size,
     }
     
     // then put key into the buffer
-    void *key_ptr = obj->buf + buf_idx_(obj);
-    strcpy((char *)key_ptr, key);
-    new_entry.key = key_ptr;
-    buf_idx_(obj) += key_size;
+    if (flags & ENTRY_KEY_BORROWED_)
+    {
+        new_entry.key = key;
+    }
+    else
+    {
+        void *key_ptr = obj->buf + buf_idx_(obj);
+        memcpy(key_ptr, key, key_len + 1);
+        new_entry.key = key_ptr;
+        buf_idx_(obj) += key_len + 1;
+    }
     
-    // put value into the buffer
-    void *value_ptr = obj->buf + buf_idx_(obj);
-    if (NULL != value)
+    // put value into the buffer, reusing a freed slot for strings
+    void *value_ptr;
+    if (flags & ENTRY_VALUE_BORROWED_)
     {
-        memcpy(value_ptr, value, size);
+        value_ptr = value;
+        value = NULL;	// nothing to copy
+    }
+    else if (JSON_STRING == type)
+    {
+        value_ptr = value_alloc_(obj, &value_size);
+    }
+    else
+    {
+        buf_idx_(obj) += value_pad_(buf_idx_(obj), type);
+        value_ptr = obj->buf + buf_idx_(obj);
+        buf_idx_(obj) += value_size;
+    }
+    if (NULL != value)
+    {   // a string up to its end, as it may not be padded
+        size_t len = (JSON_STRING == type) ? strlen(value) + 1 : size;
+        memcpy(value_ptr, value, len);
+        memset(value_ptr + len, 0, value_size - len);
     }
     new_entry.value_ptr = value_ptr;
-    buf_idx_(obj) += value_size;
     
     // Put the new entry
-    new_entry.value_type = (NULL != value)?type:JSON_NULL;
+    new_entry.value_type = (NULL != value || (flags & ENTRY_VALUE_BORROWED_)) ? type : JSON_NULL;
     new_entry.value_size = value_size;
+    new_entry.flags = flags;
     table_ptr_(obj)[new_idx] = new_entry;
-    
     entry_count_(obj) += 1;
 
     ret.status = JSON_OK;
@@ -623,7 +1428,107 @@ static struct result_ insert_(json_t *obj, char *key, void *value, size_t size,
     return ret;
 }
 
-static void table_move_ptr_ (void *dest, void *source, json_t *obj)
+/*
+ * Insert without copying the key, nor the value if it is a string. The entry
+ * points to them where they are, for json_parse_borrowed().
+ */
+int insert_borrowed_(json_t *obj, char *key, void *value, size_t size, json_type_t type)
+{
+    uint8_t flags = ENTRY_KEY_BORROWED_ | ((JSON_STRING == type) ? ENTRY_VALUE_BORROWED_ : 0);
+    return insert_(obj, key, value, size, type, flags).status;
+}
+
+// Bytes of the value of a member to insert, or 0 for a type that is not inserted.
+static size_t item_size_(const json_member_t *item)
+{
+    switch (item->type)
+    {
+    case JSON_INT:
+        return sizeof(int32_t);
+    case JSON_FLOAT:
+        return sizeof(float);
+    case JSON_STRING:
+        return str_slot_size_(strlen(item->value));
+    case JSON_OBJECT:
+        return buf_size_((json_t *)item->value);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Insert an entry of another table again, as json_delete() does. Objects
+ * are copied, or linked again if linked.
+ */
+static int reinsert_(json_t *obj, struct entry_ *entry)
+{
+    if (JSON_OBJECT != entry->value_type)
+    {   // as it is, borrowed or not
+        int is_null = (JSON_NULL == entry->value_type);
+        return insert_(obj, entry->key, is_null ? NULL : entry->value_ptr,
+                is_null ? 0 : entry->value_size, entry->value_type,
+                entry->flags & (ENTRY_KEY_BORROWED_ | ENTRY_VALUE_BORROWED_)).status;
+    }
+    json_t child = {
+            .buf = entry->value_ptr
+    };
+    if (entry->flags & ENTRY_LINKED_)
+    {
+        return json_link_obj(obj, entry->key, &child);
+    }
+    return json_insert_obj(obj, entry->key, &child);
+}
+
+// Entries in the order of their keys in the content, or of their values if
+// the keys are borrowed; empty ones last.
+static int by_place_(const void *a, const void *b)
+{
+    const struct entry_ *entry[2] = {a, b};
+    uintptr_t place[2];
+    for (int k = 0; k < 2; k++)
+    {
+        place[k] = (NULL == entry[k]->key) ? UINTPTR_MAX :
+                (entry[k]->flags & ENTRY_KEY_BORROWED_) ? (uintptr_t)entry[k]->value_ptr :
+                (uintptr_t)entry[k]->key;
+    }
+    return (place[0] > place[1]) - (place[0] < place[1]);
+}
+
+// buf_idx after the entries of obj are put into an empty object of its table size.
+static size_t reinsert_size_(json_t *obj)
+{
+    size_t idx = sizeof(struct header_) + table_byte_size_(obj);
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        if (!(entry->flags & ENTRY_KEY_BORROWED_))
+        {
+            idx += strlen(entry->key) + 1;
+        }
+        if (JSON_NULL == entry->value_type ||
+            (entry->flags & (ENTRY_LINKED_ | ENTRY_VALUE_BORROWED_)))
+        {
+            continue;
+        }
+        json_t child = {
+                .buf = entry->value_ptr
+        };
+        idx += value_pad_(idx, entry->value_type) +
+                ((JSON_OBJECT == entry->value_type) ? buf_size_(&child) : entry->value_size);
+    }
+    return idx;
+}
+
+/*
+ * Rebase the pointers in the table of obj, which has been copied from source
+ * to dest. obj must already be at dest. Linked children stay where they are;
+ * if adopt is set they now belong to obj, otherwise to the source.
+ */
+static void table_move_ptr_ (void *dest, void *source, json_t *obj, int adopt)
 {
     // Because in some system the offset is beyond signed int
     char is_plus = ((dest - source) > 0)? 1: 0;
@@ -635,15 +1540,476 @@ static void table_move_ptr_ (void *dest, void *source, json_t *obj)
         {
             continue;
         }
+        int linked = entry->flags & ENTRY_LINKED_;
+        size_t key_offset = (entry->flags & ENTRY_KEY_BORROWED_) ? 0 : offset;
+        size_t value_offset = (entry->flags & (ENTRY_LINKED_ | ENTRY_VALUE_BORROWED_)) ? 0 : offset;
         if (is_plus)
         {
-            entry->key += offset;
-            entry->value_ptr += offset;
+            entry->key += key_offset;
+            entry->value_ptr += value_offset;
         }
         else
         {
-            entry->key -= offset;
-            entry->value_ptr -= offset;
+            entry->key -= key_offset;
+            entry->value_ptr -= value_offset;
+        }
+        if (JSON_OBJECT != entry->value_type)
+        {
+            continue;
+        }
+        json_t child = {
+                .buf = entry->value_ptr
+        };
+        if (!linked)
+        {   // a child object moved along with its parent
+            parent_ptr_(&child) = obj->buf;
+            table_move_ptr_ (dest, source, &child, adopt);
+        }
+        else if (adopt)
+        {
+            parent_ptr_(&child) = obj->buf;
+        }
+    }
+}
+
+/*
+ * Point the entry of a child in its parent to obj->buf, after the child has
+ * been moved from old_buf. A child leaving the buffer of its parent gives
+ * its place back and is linked from then on.
+ */
+static void relink_(json_t *obj, void *old_buf)
+{
+    if (NULL == parent_ptr_(obj))
+    {
+        return;
+    }
+    json_t parent = {
+            .buf = parent_ptr_(obj)
+    };
+    struct entry_ *entry = table_ptr_(&parent) + idx_in_parent_(obj);
+    if (!(entry->flags & ENTRY_LINKED_))
+    {
+        value_free_(&parent, old_buf, entry->value_size);
+        entry->value_size = 0;
+        entry->flags |= ENTRY_LINKED_;
+    }
+    entry->value_ptr = obj->buf;
+}
+
+/*
+ * Move obj to new_buf of size bytes. Only the first dirty bytes of new_buf
+ * are cleared; the rest must be zero.
+ */
+static void move_buffer_(json_t *obj, void *new_buf, size_t size, size_t dirty)
+{
+    void *old_buf = obj->buf;
+
+    // clear buffer first then copy
+    memset(new_buf, 0, dirty);
+    memcpy(new_buf, old_buf, buf_idx_(obj));
+    
+    // move pointers
+    obj->buf = new_buf;
+    table_move_ptr_ (new_buf, old_buf, obj, 1);
+    relink_(obj, old_buf);
+    
+    // Confirm
+    buf_size_(obj) = size;
+}
+
+// The freed regions of obj moved up by offset bytes along with the content.
+static void rebase_free_lists_(json_t *obj, size_t offset)
+{
+    for (size_t class = 0; class < JSON_FREE_LIST_COUNT; class++)
+    {
+        size_t at = free_list_(obj)[class];
+        size_t next;
+        if (0 != at)
+        {
+            at += offset;
+            free_list_(obj)[class] = at;
+        }
+        // next is the first member of every node, which may be unaligned
+        for (; 0 != at; at = next)
+        {
+            memcpy(&next, obj->buf + at, sizeof(next));
+            if (0 != next)
+            {
+                next += offset;
+                memcpy(obj->buf + at, &next, sizeof(next));
+            }
+        }
+    }
+}
+
+/*
+ * Place the entry at idx of a table being resized. An entry that is not
+ * placed yet is taken out of its slot, and placed in turn; placed ones do
+ * not move, so that the slots before each of them stay in use.
+ */
+static void place_moving_(json_t *obj, size_t idx)
+{
+    struct entry_ entry = table_ptr_(obj)[idx];
+    memset(table_ptr_(obj) + idx, 0, sizeof(struct entry_));
+    while (NULL != entry.key)
+    {
+        entry.flags &= ~ENTRY_MOVING_;
+        idx = entry.hash & (table_size_(obj) - 1);
+        uint32_t perturb = entry.hash;
+        while (NULL != table_ptr_(obj)[idx].key && !(table_ptr_(obj)[idx].flags & ENTRY_MOVING_))
+        {
+            idx = (5 * idx) + 1 + perturb;
+            perturb >>= PERTURB_SHIFT;
+            idx = idx & (table_size_(obj) - 1);
+        }
+        struct entry_ displaced = table_ptr_(obj)[idx];
+        table_ptr_(obj)[idx] = entry;
+        if (JSON_OBJECT == entry.value_type)
+        {   // linked or not, the child keeps its place in the table
+            json_t child = {
+                    .buf = entry.value_ptr
+            };
+            idx_in_parent_(&child) = idx;
         }
+        entry = displaced;
+    }
+}
+
+// The smallest table for count entries.
+static size_t compact_table_size_(size_t count)
+{
+    size_t table_size = 1;
+    while (table_size < count)
+    {
+        table_size <<= 1;
+    }
+    return table_size;
+}
+
+// Insert the entries of obj into clone, sized by json_compact_size().
+static int clone_into_(json_t *clone, json_t *obj)
+{
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        struct result_ ret;
+        switch (entry->value_type)
+        {
+        case JSON_INT:
+        case JSON_FLOAT:
+            ret = insert_(clone, entry->key, entry->value_ptr, sizeof(int32_t),
+                    entry->value_type, 0);
+            break;
+        case JSON_STRING:
+            ret = insert_(clone, entry->key, entry->value_ptr,
+                    strlen(entry->value_ptr) + 1, JSON_STRING, 0);
+            break;
+        case JSON_OBJECT:
+            {
+                json_t child = {
+                        .buf = entry->value_ptr
+                };
+                size_t size = json_compact_size(&child);
+                ret = insert_(clone, entry->key, NULL, size, JSON_OBJECT, 0);
+                if (JSON_OK != ret.status)
+                {
+                    break;
+                }
+                json_t child_clone = json_init(table_ptr_(clone)[ret.idx].value_ptr, size,
+                        compact_table_size_(entry_count_(&child)));
+                parent_ptr_(&child_clone) = clone->buf;
+                idx_in_parent_(&child_clone) = ret.idx;
+                table_ptr_(clone)[ret.idx].value_type = JSON_OBJECT;
+                str_len_update_(clone, 4, 2);	// "null" to "{}"
+                ret.status = clone_into_(&child_clone, &child);
+            }
+            break;
+        default:
+            ret = insert_(clone, entry->key, NULL, 0, JSON_NULL, 0);
+            break;
+        }
+        if (JSON_OK != ret.status)
+        {
+            return ret.status;
+        }
+    }
+    return JSON_OK;
+}
+
+static void memory_stats_(json_t *obj, size_t depth, json_memory_stats_t *stats)
+{
+    size_t children = 0;	// bytes of the children in the content
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        if (entry->flags & ENTRY_KEY_BORROWED_)
+        {
+            stats->borrowed_bytes += strlen(entry->key) + 1;
+        }
+        if (entry->flags & ENTRY_VALUE_BORROWED_)
+        {
+            stats->borrowed_bytes += entry->value_size;
+        }
+        size_t probe = probe_len_(obj, entry->hash);
+        stats->avg_probe += probe;
+        stats->max_probe = (probe > stats->max_probe) ? probe : stats->max_probe;
+        if (JSON_STRING == entry->value_type)
+        {
+            stats->padding_bytes += entry->value_size - (strlen(entry->value_ptr) + 1);
+        }
+        else if (JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            if (entry->flags & ENTRY_LINKED_)
+            {
+                stats->buffer_bytes += buf_size_(&child);
+            }
+            else
+            {
+                children += entry->value_size;
+            }
+            memory_stats_(&child, depth + 1, stats);
+        }
+    }
+    // freed slots, unless the lists make way for the seqlock
+    struct free_node_ node;
+    for (size_t class = 0; class < JSON_FREE_LIST_COUNT && !is_concurrent_(obj); class++)
+    {
+        for (size_t offset = free_list_(obj)[class]; 0 != offset; offset = node.next)
+        {
+            memcpy(&node, obj->buf + offset, 0 == class ? sizeof(node.next) : sizeof(node));
+            stats->freed_bytes += 0 == class ? sizeof(size_t) : node.size;
+        }
+    }
+    size_t content = buf_idx_(obj) - (sizeof(struct header_) + table_byte_size_(obj)) - children;
+    size_t slack = buf_size_(obj) - buf_idx_(obj);
+    stats->header_bytes += sizeof(struct header_);
+    stats->table_bytes += table_byte_size_(obj);
+    stats->content_bytes += content;
+    stats->slack_bytes += slack;
+    stats->object_count += 1;
+    stats->entry_count += entry_count_(obj);
+    stats->slot_count += table_size_(obj);
+
+    depth = (depth < JSON_STATS_DEPTH) ? depth : JSON_STATS_DEPTH - 1;
+    stats->depth[depth].object_count += 1;
+    stats->depth[depth].entry_count += entry_count_(obj);
+    stats->depth[depth].bytes += sizeof(struct header_) + table_byte_size_(obj) + content + slack;
+}
+
+// Slots get_idx_() looks at to find the entry of hash, which must exist.
+// The sequence reaches every slot, so it ends.
+static size_t probe_len_(json_t *obj, int32_t hash)
+{
+    size_t idx = hash & (table_size_(obj) - 1);
+    uint32_t perturb = hash;
+    size_t len = 1;
+    while (hash != table_ptr_(obj)[idx].hash)
+    {
+        idx = (5 * idx) + 1 + perturb;
+        perturb >>= PERTURB_SHIFT;
+        idx = idx & (table_size_(obj) - 1);
+        len++;
+    }
+    return len;
+}
+
+/*
+ * Add the change in length of a value to the object and all its parents,
+ * as each one contains it.
+ */
+static void str_len_update_(json_t *obj, size_t old_len, size_t new_len)
+{
+    struct header_ *header = header_ptr_(obj);
+    while (NULL != header)
+    {
+        header->str_len = header->str_len - old_len + new_len;
+        header = header->parent;
+    }
+}
+
+static size_t free_class_(size_t size)
+{
+    size_t class = 0;
+    for (size >>= 4; size > 0 && class < JSON_FREE_LIST_COUNT - 1; size >>= 1)
+    {
+        class++;
+    }
+    return class;
+}
+
+/*
+ * Allocate a value slot of at least *size bytes in the content block.
+ * A freed slot is taken first; *size is set to the size of the slot given.
+ */
+static void *value_alloc_(json_t *obj, size_t *size)
+{
+    if (*size <= sizeof(size_t) && 0 != free_list_(obj)[0])
+    {   // a word slot, its node is the next offset only
+        void *ptr = obj->buf + free_list_(obj)[0];
+        memcpy(&free_list_(obj)[0], ptr, sizeof(size_t));
+        *size = sizeof(size_t);
+        return ptr;
+    }
+    struct free_node_ node;
+    // word slots were tried above, they may be smaller than *size
+    size_t class = free_class_(*size);
+    for (class = class > 0 ? class : 1; class < JSON_FREE_LIST_COUNT; class++)
+    {
+        // first fit. Every slot in a bigger class fits, except in the last.
+        void *prev = NULL;
+        size_t offset = free_list_(obj)[class];
+        while (0 != offset)
+        {
+            void *ptr = obj->buf + offset;
+            memcpy(&node, ptr, sizeof(node));
+            if (node.size >= *size)
+            {
+                if (NULL == prev)
+                {
+                    free_list_(obj)[class] = node.next;
+                }
+                else
+                {   // next is the first member of the node
+                    memcpy(prev, &node.next, sizeof(node.next));
+                }
+                *size = node.size;
+                return ptr;
+            }
+            prev = ptr;
+            offset = node.next;
+        }
+    }
+    // nothing fits, append
+    if (buf_idx_(obj) + *size > buf_size_(obj))
+    {
+        return NULL;
+    }
+    void *ptr = obj->buf + buf_idx_(obj);
+    buf_idx_(obj) += *size;
+    return ptr;
+}
+
+static void value_free_(json_t *obj, void *ptr, size_t size)
+{
+    if (size < sizeof(size_t))
+    {   // Too small to track. It is given back by json_delete() or json_clear().
+        return;
+    }
+    size_t class = free_class_(size);
+    struct free_node_ node = {
+        .next = free_list_(obj)[class],
+        .size = size
+    };
+    // a word slot keeps the next offset only
+    memcpy(ptr, &node, 0 == class ? sizeof(node.next) : sizeof(node));
+    free_list_(obj)[class] = ptr - obj->buf;
+}
+
+// Set the value at idx, a result of find_idx_().
+static int set_at_(json_t *obj, int idx, void *value)
+{
+#ifdef JSON_HAS_ATOMIC
+    if (is_concurrent_(obj))
+    {   // numbers only, from any thread
+        return (idx >= 0) ? concurrent_update_(obj, table_ptr_(obj) + idx, value, 0) : JSON_ERROR;
+    }
+#endif
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    if (idx >= 0)
+    {
+        set_value_(obj, table_ptr_(obj) + idx, value);
+        return JSON_OK;
+    }
+    return JSON_ERROR;
+}
+
+static void set_value_(json_t *obj, struct entry_ *entry, const void *value)
+{
+    size_t old_len = value_strlen_(entry->value_type, entry->value_ptr);
+    memcpy(entry->value_ptr, value, entry->value_size);
+    str_len_update_(obj, old_len, value_strlen_(entry->value_type, entry->value_ptr));
+    mark_changed_(obj, entry);
+}
+
+static int add_(json_t *obj, char *key, const void *value, json_type_t type)
+{
+    int idx = get_idx_(obj, key);
+    if (idx < 0)
+    {
+        return JSON_ERROR;
+    }
+    struct entry_ *entry = table_ptr_(obj) + idx;
+    if (type != entry->value_type)
+    {
+        return JSON_TYPE_MISMATCH;
+    }
+#ifdef JSON_HAS_ATOMIC
+    if (is_concurrent_(obj))
+    {
+        return concurrent_update_(obj, entry, value, 1);
+    }
+#endif
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    if (JSON_INT == type)
+    {   // wraps around as two's complement
+        uint32_t sum;
+        uint32_t addend;
+        memcpy(&sum, entry->value_ptr, sizeof(sum));
+        memcpy(&addend, value, sizeof(addend));
+        sum += addend;
+        set_value_(obj, entry, &sum);
+    }
+    else
+    {
+        float sum;
+        float addend;
+        memcpy(&sum, entry->value_ptr, sizeof(sum));
+        memcpy(&addend, value, sizeof(addend));
+        sum += addend;
+        set_value_(obj, entry, &sum);
+    }
+    return JSON_OK;
+}
+
+/*
+ * Record a change for json_strcpy_cached(): a changed value if entry is
+ * given, added or removed entries otherwise. The entry of the object in
+ * each of its parents is marked as well.
+ */
+static void mark_changed_(json_t *obj, struct entry_ *entry)
+{
+    if (NULL == entry)
+    {
+        header_flags_(obj) |= HEADER_LAYOUT_CHANGED_;
+    }
+    else
+    {
+        entry->flags |= ENTRY_DIRTY_;
+    }
+    struct header_ *header = header_ptr_(obj);
+    while (NULL != header->parent)
+    {
+        json_t parent = {
+                .buf = header->parent
+        };
+        table_ptr_(&parent)[header->parent_entry_idx].flags |= ENTRY_DIRTY_;
+        header = header->parent;
     }
 }
@@ -1,6 +1,7 @@
 #ifndef __JSON_H__
 #define __JSON_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -12,6 +13,7 @@
 #define JSON_BUFFER_FULL    		-5
 #define JSON_ENTRY_BUFFER_FULL		-6
 #define JSON_TYPE_MISMATCH			-7
+#define JSON_FROZEN					-8   // changed after json_freeze()
 
 typedef uint8_t json_type_t;
 	#define JSON_INT		1
@@ -28,12 +30,259 @@ typedef struct
     void *buf;
 }json_t;
 
+// Number of size classes for freed value regions in the content block.
+// Class 0 holds word slots, of at least sizeof(size_t) and smaller than
+// 16 bytes; class n holds regions smaller than 16 << n bytes, the last
+// class the rest. Regions smaller than a word are not reused.
+#ifndef JSON_FREE_LIST_COUNT
+	#define JSON_FREE_LIST_COUNT	4
+#endif
+
+// Shapes of the header of an object and of an entry of its table, which are
+// in json_internal.h, so that buffers can be sized at compile time. The
+// sizes are checked against the real ones there.
+struct json_header_shape_
+{
+	void *parent;
+	size_t size[6 + JSON_FREE_LIST_COUNT];
+	uint8_t flags;
+};
+struct json_entry_shape_
+{
+	int32_t hash;
+	void *ptr[2];
+	size_t size;
+	uint8_t type[2];
+};
+#define JSON_HEADER_SIZE	sizeof(struct json_header_shape_)
+#define JSON_ENTRY_SIZE		sizeof(struct json_entry_shape_)
+// Smallest buffer json_init() takes for a table of table_size slots.
+#define JSON_INIT_SIZE(table_size)	(JSON_HEADER_SIZE + (table_size) * JSON_ENTRY_SIZE)
+
+// Output buffer of json_serialize(). When it runs out of space, grow() is
+// called with the total size required and should enlarge buf or fail.
+// Without grow() the output is truncated, but len still counts everything.
+typedef struct json_out
+{
+    char *buf;
+    size_t size;
+    size_t len;
+    int (*grow)(struct json_out *out, size_t required);
+}json_out_t;
+
+// I/O vector for json_to_iovec(). It is struct iovec where there is one,
+// so that the result can be given to writev() or sendmsg() as it is.
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/uio.h>
+	typedef struct iovec json_iovec_t;
+#else
+	typedef struct
+	{
+		void *iov_base;
+		size_t iov_len;
+	}json_iovec_t;
+#endif
+
+// Keys and strings shorter than this are copied by json_to_iovec() rather
+// than referenced, as a vector entry costs more than copying them.
+#ifndef JSON_IOVEC_MIN_REF
+	#define JSON_IOVEC_MIN_REF	16
+#endif
+
+// Maximum nesting depth json_write_chunk() can follow.
+#ifndef JSON_WRITER_DEPTH
+	#define JSON_WRITER_DEPTH	8
+#endif
+
+// Maximum nesting depth json_snapshot_map() and json_from_cbor() accept
+// from their input.
+#ifndef JSON_INPUT_DEPTH
+	#define JSON_INPUT_DEPTH	64
+#endif
+
+// Longest key or string json_from_cbor() accepts. Both are copied to a
+// buffer of this size to be terminated, once per call.
+#ifndef JSON_CBOR_TEXT_MAX
+	#define JSON_CBOR_TEXT_MAX	255
+#endif
+
+// State of a resumable serialization. See json_write_chunk().
+typedef struct
+{
+    struct
+    {
+        void *buf;
+        size_t idx;
+        uint8_t is_first;
+    } frame[JSON_WRITER_DEPTH];
+    uint8_t depth;
+    uint8_t state;
+    const char *piece;		// piece being written
+    size_t piece_len;
+    size_t piece_idx;
+    uint8_t piece_is_ref;	// piece is in the object buffer
+    uint8_t gen_len;
+    char gen[32 + JSON_WRITER_DEPTH];	// punctuation and numbers between keys and strings
+}json_writer_t;
+
+// A member of an object, by json_next() and json_get_many(), or to
+// json_insert_batch().
+typedef struct
+{
+    char *key;
+    void *value;
+    json_type_t type;
+}json_member_t;
+
+// Place of a value in the output of json_strcpy_cached().
+typedef struct
+{
+    size_t start;
+    size_t len;
+}json_span_t;
+
+// Keys json_get_many() hashes and prefetches at a time.
+#ifndef JSON_GET_MANY_BATCH
+	#define JSON_GET_MANY_BATCH	16
+#endif
+
+// Levels of a path of json_path_compile().
+#ifndef JSON_PATH_DEPTH
+	#define JSON_PATH_DEPTH	8
+#endif
+
+// JSON Pointer compiled by json_path_compile(): the hash of each level, and
+// its table index once json_path_resolve() found it.
+typedef struct
+{
+    int32_t hash[JSON_PATH_DEPTH];
+    uint32_t idx[JSON_PATH_DEPTH];
+    size_t depth;
+}json_path_t;
+
+/*
+ * Field of a struct bound to a key, for json_parse_into() and
+ * json_write_from(). JSON_INT fields are signed integers of 8 to 32 bits,
+ * as numbers are int32_t, and a value out of the range of its field is an
+ * error. JSON_FLOAT fields are float: numbers are parsed and written as
+ * floats, so double fields are refused. JSON_STRING fields are char arrays.
+ * A JSON_OBJECT field is a struct of its own descriptor.
+ */
+typedef struct json_field
+{
+    const char *key;
+    size_t key_len;
+    json_type_t type;
+    size_t offset;
+    size_t size;
+    const struct json_desc *desc;
+}json_field_t;
+
+typedef struct json_desc
+{
+    const json_field_t *fields;
+    size_t count;
+}json_desc_t;
+
+/*
+ * Fields named as their keys. They also fit an X-macro list:
+ *   #define SENSOR_FIELDS(X) X(sensor_t, id, JSON_INT) X(sensor_t, name, JSON_STRING)
+ *   static const json_field_t sensor_fields[] = { SENSOR_FIELDS(JSON_FIELD) };
+ *   static const json_desc_t sensor_desc = JSON_DESC(sensor_fields);
+ */
+#define JSON_FIELD(type, field, json_type) \
+	{ #field, sizeof(#field) - 1, (json_type), offsetof(type, field), \
+	  JSON_FIELD_SIZE_(type, field, json_type), NULL },
+#define JSON_FIELD_OBJ(type, field, field_desc) \
+	{ #field, sizeof(#field) - 1, JSON_OBJECT, offsetof(type, field), \
+	  sizeof(((type *)0)->field), &(field_desc) },
+#define JSON_DESC(fields)	{ (fields), sizeof(fields) / sizeof((fields)[0]) }
+// The size of a field; a JSON_FLOAT field that is not a float, or a JSON_INT
+// field wider than int32_t, does not compile.
+#define JSON_FIELD_SIZE_(type, field, json_type) \
+	(sizeof(((type *)0)->field) + 0 * sizeof(char[ \
+	  (JSON_FLOAT != (json_type) || sizeof(float) == sizeof(((type *)0)->field)) && \
+	  (JSON_INT != (json_type) || sizeof(int32_t) >= sizeof(((type *)0)->field)) ? 1 : -1]))
+
+// Pad numbers with leading spaces to their longest length, so that a
+// changed number never moves the rest of the cached output.
+#define JSON_CACHE_FIXED_WIDTH	0x01
+
+// Last output of an object, kept by json_strcpy_cached(). span needs one
+// element for each entry of the table, or every call writes everything.
+typedef struct
+{
+    char *buf;
+    size_t size;
+    size_t len;			// 0 until the first write
+    json_span_t *span;
+    size_t span_count;
+    uint8_t flags;
+}json_cache_t;
+
+// Depths json_memory_stats() reports apart. Deeper objects are added to
+// the last one.
+#ifndef JSON_STATS_DEPTH
+	#define JSON_STATS_DEPTH	4
+#endif
+
+// Memory of an object and its children, by json_memory_stats(). Bytes are
+// counted once: the content of an object does not include its children.
+typedef struct
+{
+    size_t buffer_bytes;	// the buffer and the ones of linked children
+    size_t header_bytes;
+    size_t table_bytes;
+    size_t content_bytes;	// keys and values, used or freed
+    size_t padding_bytes;	// of content_bytes, string slots beyond the string
+    size_t freed_bytes;		// of content_bytes, freed slots not yet reused
+    size_t slack_bytes;		// unused after buf_idx
+    size_t borrowed_bytes;	// keys and strings in the input, by json_parse_borrowed()
+    size_t object_count;
+    size_t entry_count;
+    size_t slot_count;		// entries of the tables
+    float load_factor;		// entry_count / slot_count
+    float avg_probe;		// table slots looked at to find a key, 1 at best
+    size_t max_probe;
+    struct
+    {
+        size_t object_count;
+        size_t entry_count;
+        size_t bytes;		// header, table, content and slack
+    } depth[JSON_STATS_DEPTH];
+}json_memory_stats_t;
+
+// Published frozen object, read without locks. See json_atomic_acquire().
+// Each reader thread takes a slot of its own, from 0 to JSON_ATOMIC_READERS-1.
+#if defined(__GNUC__) || defined(__clang__)
+	#define JSON_HAS_ATOMIC
+
+	#ifndef JSON_ATOMIC_READERS
+		#define JSON_ATOMIC_READERS	64
+	#endif
+	#ifndef JSON_CACHE_LINE
+		#define JSON_CACHE_LINE		64
+	#endif
+
+typedef struct
+{
+    void *buf;
+    size_t epoch;
+    // a line for each reader, so that readers do not share lines
+    struct
+    {
+        size_t epoch;		// epoch the reader came in at, 0 when outside
+    } __attribute__((aligned(JSON_CACHE_LINE))) reader[JSON_ATOMIC_READERS];
+}json_atomic_ref_t;
+#endif
+
 #ifdef __cplusplus
 extern "C"{
 #endif
 
 // core utility functions
 int32_t json_hash(char *str);
+int32_t json_hash_n(const char *key, size_t len);
 
 // lower-level basic functions
 json_t json_init(void *buffer, size_t buf_size, size_t table_size);
@@ -46,7 +295,9 @@ int json_insert_str(json_t *obj, char *key, char *value);
 int json_insert_int(json_t *obj, char *key, int32_t value);
 int json_insert_float(json_t *obj, char *key, float value);
 int json_insert_obj(json_t *obj, char *key, json_t *input);
+int json_link_obj(json_t *obj, char *key, json_t *input);
 int json_insert_empty_obj(json_t *obj, char *key, size_t size);	// make it internal?
+int json_insert_batch(json_t *obj, const json_member_t *items, size_t n);
 
 // Getter functions
 void  *json_get(json_t *obj, char *key, json_type_t type);
@@ -54,27 +305,79 @@ char  *json_get_str(json_t *obj, char *key);
 int	   json_get_int(json_t *obj, char *key);
 float  json_get_float(json_t *obj, char *key);
 json_t json_get_obj(json_t *obj, char *key);
+void  *json_get_hashed(json_t *obj, int32_t hash, json_type_t type);
+size_t json_get_many(json_t *obj, char **keys, size_t n, json_member_t *out);
+void  *json_get_path(json_t *obj, const char *pointer, json_type_t type);
+int    json_path_compile(json_path_t *path, const char *pointer);
+int    json_path_resolve(json_path_t *path, json_t *obj);
+void  *json_path_get(const json_path_t *path, json_t *obj, json_type_t type);
 
 // Setter functions
 int json_set(json_t *obj, char *key, void *value);
 int json_set_str(json_t *obj, char *key, char *value);
 int json_set_int(json_t *obj, char *key, int value);
 int json_set_float(json_t *obj, char *key, float value);
+int json_set_hashed(json_t *obj, int32_t hash, void *value);
+int json_add_int(json_t *obj, char *key, int32_t value);
+int json_add_float(json_t *obj, char *key, float value);
+int json_increment(json_t *obj, char *key);
 
 // String-related functions
 int json_parse(json_t *obj, char *input);
+int json_parse_borrowed(json_t *obj, char *input);
 int json_strcpy(char *dest, json_t *obj);
+int json_strncpy(char *dest, json_t *obj, size_t size);
 int json_strlen(json_t *obj);
+int json_serialize(json_out_t *out, json_t *obj);
+int json_writer_init(json_writer_t *writer, json_t *obj);
+int json_write_chunk(json_writer_t *writer, char *out, size_t cap);
+int json_to_iovec(json_writer_t *writer, json_iovec_t *iov, int iov_count,
+		char *side_buf, size_t side_size);
+int json_cache_init(json_cache_t *cache, char *buf, size_t size,
+		json_span_t *span, size_t span_count, uint8_t flags);
+int json_strcpy_cached(json_cache_t *cache, json_t *obj);
+
+// Struct binding, without an object in between
+int json_parse_into(void *dest, const json_desc_t *desc, const char *input);
+int json_write_from(const void *src, const json_desc_t *desc, json_out_t *out);
+
+// Binary encoding
+int json_to_cbor(uint8_t *dest, json_t *obj, size_t size);
+int json_from_cbor(json_t *obj, const uint8_t *input, size_t len);
 
 // Buffer and memory management functions
 int json_replace_buffer(json_t *obj, void *new_buf, size_t size);
 int json_double_table(json_t *obj);
 json_t json_copy(void *dest_buf, json_t *obj);
+size_t json_compact_size(json_t *obj);
+json_t json_clone_compact(void *dest, size_t cap, json_t *obj);
+int json_relocate(json_t *obj, void *old_buf);
+int json_freeze(json_t *obj);
+int json_is_frozen(json_t *obj);
+
+// Lock-free sharing of objects between threads
+#ifdef JSON_HAS_ATOMIC
+void json_atomic_init(json_atomic_ref_t *ref, json_t *obj);
+json_t json_atomic_acquire(json_atomic_ref_t *ref, size_t reader);
+void json_atomic_release(json_atomic_ref_t *ref, size_t reader);
+json_t json_atomic_publish(json_atomic_ref_t *ref, json_t *obj);
+int json_make_concurrent(json_t *obj);
+int json_is_concurrent(json_t *obj);
+#endif
+
+// Snapshot files, mapped without parsing
+#if defined(__unix__) || defined(__APPLE__)
+int json_snapshot_write(json_t *obj, int fd);
+json_t json_snapshot_map(const char *path);
+int json_snapshot_unmap(json_t *obj);
+#endif
 
 // Other utility functions
 size_t json_table_size(json_t *obj);
 size_t json_count(json_t *obj);
+int json_next(json_t *obj, size_t *idx, json_member_t *member);
 size_t json_buffer_size(json_t *obj);
+int json_memory_stats(json_t *obj, json_memory_stats_t *stats);
 
 
 // Debugging Support
@@ -0,0 +1,261 @@
+#include "json.h"
+#include <string.h>
+#include "json_internal.h"
+
+#ifdef JSON_HAS_ATOMIC
+
+/*
+ * Read-copy-update of a frozen object. Readers announce the epoch they come
+ * in at, in a line of their own, and read the object without locks. A
+ * writer swaps in a new object, starts a new epoch and waits until no
+ * reader of an older epoch is left. The old object is then quiescent and
+ * given back to be freed.
+ */
+
+static int has_room_(json_t *obj);
+static void make_concurrent_(json_t *obj);
+static size_t number_size_(json_t *obj, size_t idx);
+
+/*******************************************************************************
+ * Atomic reference functions
+ ******************************************************************************/
+
+// obj is frozen. It may be an object with a NULL buffer.
+void json_atomic_init(json_atomic_ref_t *ref, json_t *obj)
+{
+    if (NULL != obj->buf)
+    {
+        json_freeze(obj);
+    }
+    memset(ref, 0, sizeof(*ref));
+    ref->buf = obj->buf;
+    ref->epoch = 1;
+}
+
+/*
+ * Get the current object for reader, a slot no other thread uses at the
+ * same time. It stays valid until json_atomic_release().
+ */
+json_t json_atomic_acquire(json_atomic_ref_t *ref, size_t reader)
+{
+    size_t epoch = __atomic_load_n(&ref->epoch, __ATOMIC_SEQ_CST);
+    // announced before the object is read. A writer either waits for this
+    // reader, or has swapped the object before it is read.
+    __atomic_store_n(&ref->reader[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    json_t obj = {
+            .buf = __atomic_load_n(&ref->buf, __ATOMIC_SEQ_CST)
+    };
+    return obj;
+}
+
+void json_atomic_release(json_atomic_ref_t *ref, size_t reader)
+{
+    __atomic_store_n(&ref->reader[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Replace the object with obj, frozen, and return the old one once no
+ * reader can see it any more. Readers are never blocked; this waits for
+ * the ones that came in before.
+ */
+json_t json_atomic_publish(json_atomic_ref_t *ref, json_t *obj)
+{
+    if (NULL != obj->buf)
+    {
+        json_freeze(obj);
+    }
+    json_t old = {
+            .buf = __atomic_exchange_n(&ref->buf, obj->buf, __ATOMIC_SEQ_CST)
+    };
+    size_t epoch = __atomic_add_fetch(&ref->epoch, 1, __ATOMIC_SEQ_CST);
+    for (size_t i = 0; i < JSON_ATOMIC_READERS; i++)
+    {
+        size_t reader_epoch;
+        do
+        {
+            reader_epoch = __atomic_load_n(&ref->reader[i].epoch, __ATOMIC_ACQUIRE);
+        } while (0 != reader_epoch && reader_epoch < epoch);
+    }
+    return old;
+}
+
+/*******************************************************************************
+ * Concurrent numbers
+ ******************************************************************************/
+
+/*
+ * Let many threads change the numbers of obj and its children at once,
+ * without locks, by json_set_int(), json_set_float(), json_add_int() and
+ * json_add_float(). The layout is frozen as by json_freeze(), so strings
+ * cannot be changed either. json_strcpy(), json_strncpy() and
+ * json_serialize() write the numbers as they are at one moment, and retry
+ * while they are being changed; as the length changes with the numbers,
+ * size the output for the longest ones.
+ * Call it before the object is shared. Numbers are stored aligned, so none
+ * is moved unless the root buffer is not; each misaligned one is then moved
+ * to an aligned slot at the end of the buffer of its object, for up to 7
+ * bytes. JSON_BUFFER_FULL if there is no room; nothing is changed then.
+ */
+int json_make_concurrent(json_t *obj)
+{
+    if (is_concurrent_(obj))
+    {
+        return JSON_OK;
+    }
+    if (is_frozen_(obj))
+    {
+        return JSON_FROZEN;
+    }
+    if (!has_room_(obj))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    make_concurrent_(obj);
+    return JSON_OK;
+}
+
+int json_is_concurrent(json_t *obj)
+{
+    return is_concurrent_(obj) ? 1 : 0;
+}
+
+// Bytes json_make_concurrent() needs at the end of obj, without its children.
+size_t concurrent_room_(json_t *obj)
+{
+    size_t idx = buf_idx_(obj);
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        if (0 != number_size_(obj, i))
+        {
+            idx += (-((uintptr_t)obj->buf + idx)) & 3;
+            idx += number_size_(obj, i);
+        }
+    }
+    return idx - buf_idx_(obj);
+}
+
+/*
+ * The number is stored in a write of the seqlock. The length is added to
+ * the parents after it, as snapshots do not use it, so that writes are
+ * short and readers retry less.
+ */
+int concurrent_update_(json_t *obj, struct entry_ *entry, const void *value, int add)
+{
+    json_type_t type = entry->value_type;
+    if (JSON_INT != type && JSON_FLOAT != type)
+    {
+        return JSON_FROZEN;
+    }
+    struct header_ *root = concurrent_root_(obj);
+    uint32_t *slot = entry->value_ptr;	// aligned by json_make_concurrent()
+    uint32_t bits;
+    uint32_t old_bits;
+    uint32_t new_bits;
+    memcpy(&bits, value, sizeof(bits));
+
+    __atomic_fetch_add(&root->u.seq.begin, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (!add)
+    {
+        old_bits = __atomic_exchange_n(slot, bits, __ATOMIC_RELAXED);
+        new_bits = bits;
+    }
+    else if (JSON_INT == type)
+    {   // wraps around as two's complement
+        old_bits = __atomic_fetch_add(slot, bits, __ATOMIC_RELAXED);
+        new_bits = old_bits + bits;
+    }
+    else
+    {
+        old_bits = __atomic_load_n(slot, __ATOMIC_RELAXED);
+        do
+        {
+            float sum;
+            float addend;
+            memcpy(&sum, &old_bits, sizeof(sum));
+            memcpy(&addend, &bits, sizeof(addend));
+            sum += addend;
+            memcpy(&new_bits, &sum, sizeof(new_bits));
+        } while (!__atomic_compare_exchange_n(slot, &old_bits, new_bits, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+    __atomic_fetch_add(&root->u.seq.end, 1, __ATOMIC_RELEASE);
+
+    size_t old_len = value_strlen_(type, &old_bits);
+    size_t new_len = value_strlen_(type, &new_bits);
+    for (struct header_ *header = header_ptr_(obj);
+            old_len != new_len && NULL != header; header = header->parent)
+    {
+        __atomic_add_fetch(&header->str_len, new_len - old_len, __ATOMIC_RELAXED);
+    }
+    return JSON_OK;
+}
+
+static int has_room_(json_t *obj)
+{
+    if (concurrent_room_(obj) > buf_size_(obj) - buf_idx_(obj))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL != entry->key && JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            if (!has_room_(&child))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Move misaligned numbers to the end, then mark obj and its children.
+static void make_concurrent_(json_t *obj)
+{
+    header_flags_(obj) = HEADER_FROZEN_ | HEADER_CONCURRENT_;	// changes are not tracked
+    // freed regions are not reused any more, and their lists make way for the seqlock
+    header_ptr_(obj)->u.seq.begin = 0;
+    header_ptr_(obj)->u.seq.end = 0;
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        entry->flags &= ~ENTRY_DIRTY_;
+        size_t size = number_size_(obj, i);
+        if (0 != size)
+        {   // the old slot is left unused
+            buf_idx_(obj) += (-((uintptr_t)obj->buf + buf_idx_(obj))) & 3;
+            void *value_ptr = obj->buf + buf_idx_(obj);
+            memcpy(value_ptr, entry->value_ptr, size);
+            entry->value_ptr = value_ptr;
+            entry->value_size = size;
+            buf_idx_(obj) += size;
+        }
+        else if (NULL != entry->key && JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            make_concurrent_(&child);
+        }
+    }
+}
+
+// Size of the number at idx if it has to be moved, 0 otherwise.
+static size_t number_size_(json_t *obj, size_t idx)
+{
+    struct entry_ *entry = table_ptr_(obj) + idx;
+    if (NULL == entry->key ||
+            (JSON_INT != entry->value_type && JSON_FLOAT != entry->value_type) ||
+            0 == ((uintptr_t)entry->value_ptr & 3))
+    {
+        return 0;
+    }
+    return sizeof(uint32_t);
+}
+
+#endif
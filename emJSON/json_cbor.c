@@ -0,0 +1,490 @@
+#include "json.h"
+#include <string.h>
+#include "json_internal.h"
+
+/*
+ * CBOR (RFC 8949) encoding of objects. Objects are maps with text keys.
+ * Ints are stored as CBOR integers, floats as half or single floats.
+ */
+
+// Major types
+#define CBOR_UINT       0x00
+#define CBOR_NEGINT     0x20
+#define CBOR_TEXT       0x60
+#define CBOR_MAP        0xa0
+#define CBOR_SIMPLE     0xe0
+    #define CBOR_NULL       0xf6
+    #define CBOR_HALF       0xf9
+    #define CBOR_SINGLE     0xfa
+    #define CBOR_DOUBLE     0xfb
+
+/*
+ * Encoder-related structs and functions
+ */
+struct cbor_out_
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+};
+
+static int encode_obj_(struct cbor_out_ *out, json_t *obj);
+static void encode_head_(struct cbor_out_ *out, uint8_t major, uint32_t value);
+static void encode_float_(struct cbor_out_ *out, float value);
+static void put_(struct cbor_out_ *out, const void *src, size_t len);
+
+/*
+ * Decoder-related structs and functions
+ */
+struct cbor_in_
+{
+    const uint8_t *i;
+    const uint8_t *end;
+    size_t depth;	// of the map being decoded
+    char key[JSON_CBOR_TEXT_MAX + 1];
+    char str[JSON_CBOR_TEXT_MAX + 1];
+};
+
+static int decode_map_(json_t *obj, struct cbor_in_ *in, uint64_t count);
+static int decode_head_(struct cbor_in_ *in, uint8_t *major, uint64_t *value);
+static int decode_float_(struct cbor_in_ *in, uint8_t initial, float *value);
+static int decode_text_(struct cbor_in_ *in, char *dest, uint64_t len);
+static int decode_child_(json_t *obj, char *key, struct cbor_in_ *in, uint64_t count);
+
+/*******************************************************************************
+ * Encoder functions
+ ******************************************************************************/
+
+/*
+ * Encode obj into dest. Like json_strncpy(), at most size bytes are written
+ * but the full length is returned, so dest may be NULL to measure it.
+ */
+int json_to_cbor(uint8_t *dest, json_t *obj, size_t size)
+{
+    struct cbor_out_ out = {
+        .buf = dest,
+        .size = (NULL == dest) ? 0 : size,
+        .len = 0
+    };
+    int ret = encode_obj_(&out, obj);
+    return (JSON_OK == ret) ? (int)out.len : ret;
+}
+
+static int encode_obj_(struct cbor_out_ *out, json_t *obj)
+{
+    encode_head_(out, CBOR_MAP, entry_count_(obj));
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {    // empty entry
+            continue;
+        }
+        size_t len = strlen(entry->key);
+        encode_head_(out, CBOR_TEXT, len);
+        put_(out, entry->key, len);
+        switch (entry->value_type)
+        {
+        case JSON_INT:
+            {   // memcpy() for the same reason as in json_get_float()
+                int32_t value;
+                memcpy(&value, entry->value_ptr, sizeof(int32_t));
+                if (value < 0)
+                {   // -1 - n
+                    encode_head_(out, CBOR_NEGINT, -(value + 1));
+                }
+                else
+                {
+                    encode_head_(out, CBOR_UINT, value);
+                }
+            }
+            break;
+        case JSON_FLOAT:
+            {
+                float value;
+                memcpy(&value, entry->value_ptr, sizeof(float));
+                encode_float_(out, value);
+            }
+            break;
+        case JSON_STRING:
+            len = strlen((char *)entry->value_ptr);
+            encode_head_(out, CBOR_TEXT, len);
+            put_(out, entry->value_ptr, len);
+            break;
+        case JSON_OBJECT:
+            {
+                json_t tmp = {
+                        .buf = entry->value_ptr
+                };
+                int ret = encode_obj_(out, &tmp);
+                if (JSON_OK != ret)
+                {
+                    return ret;
+                }
+            }
+            break;
+        case JSON_NULL:
+            encode_head_(out, CBOR_SIMPLE, CBOR_NULL & 0x1f);
+            break;
+        default:
+            return JSON_ERROR;
+        }
+    }
+    return JSON_OK;
+}
+
+// The initial byte and the value in the fewest bytes, big endian.
+static void encode_head_(struct cbor_out_ *out, uint8_t major, uint32_t value)
+{
+    uint8_t head[5];
+    size_t len;
+    if (value < 24)
+    {
+        head[0] = major | value;
+        len = 1;
+    }
+    else if (value <= 0xff)
+    {
+        head[0] = major | 24;
+        head[1] = value;
+        len = 2;
+    }
+    else if (value <= 0xffff)
+    {
+        head[0] = major | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        len = 3;
+    }
+    else
+    {
+        head[0] = major | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        len = 5;
+    }
+    put_(out, head, len);
+}
+
+/*
+ * A float is written as a half float when that holds it exactly, which is
+ * the case for small whole numbers and simple fractions.
+ */
+static void encode_float_(struct cbor_out_ *out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127;
+    uint32_t mantissa = bits & 0x7fffff;
+    uint8_t buf[5];
+
+    if ((bits & 0x7fffffff) == 0)
+    {   // zero
+        buf[0] = CBOR_HALF;
+        buf[1] = sign >> 8;
+        buf[2] = 0;
+        put_(out, buf, 3);
+        return;
+    }
+    if (exponent >= -14 && exponent <= 15 && (mantissa & 0x1fff) == 0)
+    {   // a normal half float
+        uint32_t half = sign | ((exponent + 15) << 10) | (mantissa >> 13);
+        buf[0] = CBOR_HALF;
+        buf[1] = half >> 8;
+        buf[2] = half;
+        put_(out, buf, 3);
+        return;
+    }
+    buf[0] = CBOR_SINGLE;
+    buf[1] = bits >> 24;
+    buf[2] = bits >> 16;
+    buf[3] = bits >> 8;
+    buf[4] = bits;
+    put_(out, buf, 5);
+}
+
+static void put_(struct cbor_out_ *out, const void *src, size_t len)
+{
+    if (out->len + len <= out->size)
+    {
+        memcpy(out->buf + out->len, src, len);
+    }
+    else if (out->len < out->size)
+    {   // truncate
+        memcpy(out->buf + out->len, src, out->size - out->len);
+    }
+    out->len += len;
+}
+
+/*******************************************************************************
+ * Decoder functions
+ ******************************************************************************/
+
+/*
+ * Insert the entries of a CBOR map into obj. Returns the number of bytes
+ * read, or an error code like json_parse().
+ * Only maps with text keys, integers, floats, text and nested maps are
+ * supported. Integers must fit in int32_t; doubles are rounded to float.
+ * Keys and strings are at most JSON_CBOR_TEXT_MAX bytes, and maps nest at
+ * most JSON_INPUT_DEPTH deep.
+ */
+int json_from_cbor(json_t *obj, const uint8_t *input, size_t len)
+{
+    struct cbor_in_ in = {
+        .i = input,
+        .end = input + len,
+        .depth = 0
+    };
+    uint8_t major;
+    uint64_t count;
+    int ret = decode_head_(&in, &major, &count);
+    if (JSON_OK != ret || CBOR_MAP != major)
+    {
+        return JSON_ERROR;
+    }
+    ret = decode_map_(obj, &in, count);
+    return (JSON_OK == ret) ? (int)(in.i - input) : ret;
+}
+
+// Insert count entries following the head of a map.
+static int decode_map_(json_t *obj, struct cbor_in_ *in, uint64_t count)
+{
+    uint8_t major;
+    uint64_t value;
+    int ret;
+    for (; count > 0; count--)
+    {
+        // key
+        ret = decode_head_(in, &major, &value);
+        if (JSON_OK != ret || CBOR_TEXT != major || JSON_OK != decode_text_(in, in->key, value))
+        {
+            return JSON_ERROR;
+        }
+        char *key = in->key;
+
+        // value
+        if (in->i >= in->end)
+        {
+            return JSON_ERROR;
+        }
+        uint8_t initial = *in->i;
+        if (CBOR_SIMPLE == (initial & 0xe0))
+        {
+            float f;
+            if (JSON_OK != decode_float_(in, initial, &f))
+            {
+                return JSON_ERROR;
+            }
+            ret = json_insert_float(obj, key, f);
+        }
+        else
+        {
+            ret = decode_head_(in, &major, &value);
+            if (JSON_OK != ret)
+            {
+                return ret;
+            }
+            switch (major)
+            {
+            case CBOR_UINT:
+                if (value > INT32_MAX)
+                {
+                    return JSON_ERROR;
+                }
+                ret = json_insert_int(obj, key, (int32_t)value);
+                break;
+            case CBOR_NEGINT:
+                if (value > INT32_MAX)
+                {
+                    return JSON_ERROR;
+                }
+                ret = json_insert_int(obj, key, -(int32_t)value - 1);
+                break;
+            case CBOR_TEXT:
+                if (JSON_OK != decode_text_(in, in->str, value))
+                {
+                    return JSON_ERROR;
+                }
+                ret = json_insert_str(obj, key, in->str);
+                break;
+            case CBOR_MAP:
+                ret = decode_child_(obj, key, in, value);
+                break;
+            default:
+                return JSON_ERROR;
+            }
+        }
+        if (JSON_OK != ret)
+        {
+            return ret;
+        }
+    }
+    return JSON_OK;
+}
+
+/*
+ * Read an initial byte and its argument. Indefinite lengths are not
+ * supported.
+ */
+static int decode_head_(struct cbor_in_ *in, uint8_t *major, uint64_t *value)
+{
+    if (in->i >= in->end)
+    {
+        return JSON_ERROR;
+    }
+    uint8_t info = *in->i & 0x1f;
+    *major = *in->i & 0xe0;
+    in->i += 1;
+    if (info < 24)
+    {
+        *value = info;
+        return JSON_OK;
+    }
+    if (info > 27)
+    {
+        return JSON_ERROR;
+    }
+    size_t len = (size_t)1 << (info - 24);
+    if (len > (size_t)(in->end - in->i))
+    {
+        return JSON_ERROR;
+    }
+    *value = 0;
+    for (size_t j = 0; j < len; j++)
+    {
+        *value = (*value << 8) | in->i[j];
+    }
+    in->i += len;
+    return JSON_OK;
+}
+
+// Copy the len bytes of a key or string to dest, terminated.
+static int decode_text_(struct cbor_in_ *in, char *dest, uint64_t len)
+{
+    if (len > JSON_CBOR_TEXT_MAX || len > (uint64_t)(in->end - in->i))
+    {
+        return JSON_ERROR;
+    }
+    memcpy(dest, in->i, len);
+    dest[len] = '\0';
+    in->i += len;
+    return JSON_OK;
+}
+
+static int decode_float_(struct cbor_in_ *in, uint8_t initial, float *value)
+{
+    uint8_t major;
+    uint64_t bits;
+    if (JSON_OK != decode_head_(in, &major, &bits))
+    {
+        return JSON_ERROR;
+    }
+    switch (initial)
+    {
+    case CBOR_HALF:
+        {
+            uint32_t sign = (bits & 0x8000) << 16;
+            uint32_t exponent = (bits >> 10) & 0x1f;
+            uint32_t mantissa = bits & 0x3ff;
+            uint32_t single;
+            if (0 == exponent)
+            {   // zero or subnormal: mantissa x 2^-24
+                *value = (float)mantissa / 16777216.0f;
+                if (sign)
+                {
+                    *value = -*value;
+                }
+                return JSON_OK;
+            }
+            if (0x1f == exponent)
+            {   // infinity or NaN
+                single = sign | 0x7f800000 | (mantissa << 13);
+            }
+            else
+            {
+                single = sign | ((exponent + 112) << 23) | (mantissa << 13);
+            }
+            memcpy(value, &single, sizeof(float));
+        }
+        return JSON_OK;
+    case CBOR_SINGLE:
+        {
+            uint32_t single = bits;
+            memcpy(value, &single, sizeof(float));
+        }
+        return JSON_OK;
+    case CBOR_DOUBLE:
+        {
+            double d;
+            memcpy(&d, &bits, sizeof(double));
+            *value = (float)d;
+        }
+        return JSON_OK;
+    default:
+        return JSON_ERROR;
+    }
+}
+
+/*
+ * Decode a nested map of count entries as a child object. As in json_parse(),
+ * the child takes the rest of the buffer and is trimmed afterwards.
+ */
+static int decode_child_(json_t *obj, char *key, struct cbor_in_ *in, uint64_t count)
+{
+    if (in->depth + 1 >= JSON_INPUT_DEPTH)
+    {
+        return JSON_ERROR;
+    }
+    size_t used = buf_idx_(obj) + strlen(key) + 1;
+    used += value_pad_(used, JSON_OBJECT);
+    if (used > buf_size_(obj))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    size_t size = buf_size_(obj) - used;
+    int ret = json_insert_empty_obj(obj, key, size);
+    if (JSON_OK != ret)
+    {
+        return ret;
+    }
+    json_t child = json_get_obj(obj, key);
+    size_t idx = idx_in_parent_(&child);
+
+    // The count is known, so make the table big enough for it.
+    if (count > size / sizeof(struct entry_))
+    {
+        return JSON_BUFFER_FULL;
+    }
+    size_t table_size = 4;
+    while (table_size < count)
+    {
+        table_size <<= 1;
+    }
+    if (table_size > 4)
+    {
+        child = json_init(child.buf, size, table_size);
+        if (NULL == child.buf)
+        {
+            return JSON_BUFFER_FULL;
+        }
+        parent_ptr_(&child) = obj->buf;
+        idx_in_parent_(&child) = idx;
+    }
+
+    in->depth += 1;
+    ret = decode_map_(&child, in, count);
+    in->depth -= 1;
+    if (JSON_OK != ret)
+    {
+        return ret;
+    }
+    // trim down the buffer
+    size_t offset = buf_size_(&child) - buf_idx_(&child);
+    buf_size_(&child) -= offset;
+    buf_idx_(obj) -= offset;
+    table_ptr_(obj)[idx].value_size -= offset;
+    return JSON_OK;
+}
@@ -15,8 +15,16 @@ struct entry_
     char *key;
     size_t value_size;
     json_type_t value_type;
+    uint8_t flags;
 };
 
+// entry flags
+#define ENTRY_DIRTY_    0x01	// value changed since the last cached write
+#define ENTRY_LINKED_   0x02	// an object in a buffer of its own, not in the content
+#define ENTRY_KEY_BORROWED_     0x04	// the key is in the input of json_parse_borrowed()
+#define ENTRY_VALUE_BORROWED_   0x08	// so is the string value
+#define ENTRY_MOVING_   0x10	// not placed yet, while the table is resized
+
 struct header_
 {
 	void *parent;
@@ -25,6 +33,34 @@ struct header_
     size_t buf_idx;
     size_t table_size;
     size_t entry_count;
+    union
+    {
+        size_t free_list[JSON_FREE_LIST_COUNT];	// offsets of freed regions, 0 if empty
+        struct
+        {   // of a concurrent object instead, as nothing is freed then
+            size_t begin;	// writes of numbers started
+            size_t end;		// and done
+        } seq;
+    } u;
+    size_t str_len;		// length of the serialized object, without '\0'
+    uint8_t flags;
+};
+
+// JSON_HEADER_SIZE and JSON_ENTRY_SIZE of json.h are these sizes.
+typedef char header_size_check_[(JSON_HEADER_SIZE == sizeof(struct header_)) ? 1 : -1];
+typedef char entry_size_check_[(JSON_ENTRY_SIZE == sizeof(struct entry_)) ? 1 : -1];
+
+// header flags
+#define HEADER_LAYOUT_CHANGED_  0x01	// entries added or removed since the last cached write
+#define HEADER_FROZEN_          0x02	// read-only, by json_freeze()
+#define HEADER_CONCURRENT_      0x04	// numbers changed by many threads, layout frozen
+
+// A freed value region. It is stored in the region itself; a word slot,
+// in class 0, holds next only and its size is taken as sizeof(size_t).
+struct free_node_
+{
+    size_t next;	// offset of the next region in the same class
+    size_t size;
 };
 
 
@@ -46,6 +82,26 @@ struct header_
 
 #define entry_count_(obj)   (header_ptr_(obj)->entry_count)
 
+#define free_list_(obj)     (header_ptr_(obj)->u.free_list)
+
+#define str_len_(obj)       (header_ptr_(obj)->str_len)
+
+#define header_flags_(obj)  (header_ptr_(obj)->flags)
+
+#define is_frozen_(obj)     (header_flags_(obj) & HEADER_FROZEN_)
+
+#define is_concurrent_(obj) (header_flags_(obj) & HEADER_CONCURRENT_)
+
+// A hint to load a line that is read soon.
+#if defined(__GNUC__) || defined(__clang__)
+	#define prefetch_(ptr)	__builtin_prefetch(ptr)
+#else
+	#define prefetch_(ptr)	((void)(ptr))
+#endif
+
+// String values are stored in slots of multiples of 8.
+#define str_slot_size_(len)    (((((len) + 1) >> 3) + 1) << 3)
+
 static inline size_t table_byte_size_(json_t *obj)
 {
     return header_ptr_(obj)->table_size * sizeof(struct entry_);
@@ -57,6 +113,126 @@ static inline size_t content_byte_size_(json_t *obj)
         (sizeof(struct header_) + header_ptr_(obj)->table_size * sizeof(struct entry_));
 }
 
+// Bytes of the content block in use, freed slots included.
+static inline size_t content_used_(json_t *obj)
+{
+    return header_ptr_(obj)->buf_idx -
+        (sizeof(struct header_) + header_ptr_(obj)->table_size * sizeof(struct entry_));
+}
+
+// Alignment of a value from the start of its object. Children start at a
+// word, for their headers, and numbers at 4 bytes, so that they can be
+// changed atomically; as the root buffer is aligned, so are they.
+static inline size_t value_align_(json_type_t type)
+{
+    return (JSON_OBJECT == type) ? sizeof(size_t) :
+            (JSON_INT == type || JSON_FLOAT == type) ? sizeof(int32_t) : 1;
+}
+
+// Bytes to skip at idx for a value of type.
+static inline size_t value_pad_(size_t idx, json_type_t type)
+{
+    return (0 - idx) & (value_align_(type) - 1);
+}
+
+// Length of a value as serialized. Defined in json_string.c.
+size_t value_strlen_(json_type_t type, void *value_ptr);
+
+// States of the parser, parse_() in json_string.c. The stream parser goes
+// through them too, with more of its own in between.
+enum parse_state_
+{
+    parse_start_,		// after '{'
+    parse_name_,		// after ','
+    parse_value_,		// after ':'
+    parse_end_,			// after the closing '}'
+    parse_state_count_
+};
+
+// JSON whitespace. Defined in json_string.c.
+int is_ws_(char input);
+
+// Value of a number token, for the stream parser. Defined in json_string.c.
+json_type_t number_value_(char *str, void *value);
+
+// Insert an entry referring to the key, and the value if it is a string,
+// where they are. Defined in json.c.
+int insert_borrowed_(json_t *obj, char *key, void *value, size_t size, json_type_t type);
+
+// Room for emJSON_insert_batch(): the bytes of the members, and a table of
+// table_size slots. Defined in json.c.
+int batch_bytes_(const json_member_t *items, size_t n, size_t *bytes);
+int resize_table_(json_t *obj, size_t table_size);
+
+#ifdef JSON_HAS_ATOMIC
+/*
+ * Seqlock of a concurrent object, for many writers: a write is started and
+ * done by two counters. Readers copy what they need, then retry if a write
+ * was going on or started meanwhile. Writes are made to the topmost
+ * concurrent object, so that a reader of any part of it sees them.
+ */
+static inline struct header_ *concurrent_root_(json_t *obj)
+{
+    struct header_ *header = header_ptr_(obj);
+    while (NULL != header->parent &&
+            (((struct header_ *)header->parent)->flags & HEADER_CONCURRENT_))
+    {
+        header = header->parent;
+    }
+    return header;
+}
+
+// Waits for the writes going on, rather than reading for nothing.
+static inline size_t seq_read_begin_(struct header_ *root)
+{
+    size_t seq;
+    while ((seq = __atomic_load_n(&root->u.seq.end, __ATOMIC_ACQUIRE)) !=
+            __atomic_load_n(&root->u.seq.begin, __ATOMIC_RELAXED))
+    {
+    }
+    return seq;
+}
+
+// No write was going on at seq_read_begin_(), and none started since.
+static inline int seq_read_retry_(struct header_ *root, size_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&root->u.seq.begin, __ATOMIC_RELAXED) != seq;
+}
+
+// Change a number of a concurrent object, set or added. Defined in json_atomic.c.
+int concurrent_update_(json_t *obj, struct entry_ *entry, const void *value, int add);
+size_t concurrent_room_(json_t *obj);
+#endif
+
+// Parsing an object in parts, in threads, by emJSON_parse_parallel().
+// The input is scanned and parsed in json_string.c.
+struct scan_
+{
+    size_t quotes;		// '"' in the range
+    long depth[2];		// change of depth, if the range starts out of or in a string
+};
+
+struct part_count_
+{
+    size_t members;		// of the object the part is of
+    size_t values;		// at any depth
+    size_t objects;		// nested in the part
+};
+
+int parse_range_(json_t *obj, char *input, char *stop, int borrow);
+void scan_range_(const char *begin, const char *end, struct scan_ *scan);
+char *find_member_(char *begin, char *end, int in_string, long depth);
+void count_part_(char *input, char *stop, struct part_count_ *count);
+int outer_braces_(char *input, size_t len, char **open, char **close);
+
+// The parts are joined into one object in json.c.
+size_t join_offset_(json_t *part);
+size_t join_size_(json_t *part, size_t count);
+int join_init_(json_t *obj, json_t *part, size_t count);
+void join_copy_(json_t *obj, json_t *part, size_t offset);
+int join_table_(json_t *obj, json_t *part, size_t count);
+
 
 #endif /* JSON_INTERNAL_H_ */
 
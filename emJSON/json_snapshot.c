@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+#include "json.h"
+#include <string.h>
+#include "json_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Snapshot file: a file header, then the object buffer as it is in memory,
+ * up to its last used byte. The table keeps the pointers of the saved
+ * buffer, so loading only moves them by the difference of the addresses.
+ * Snapshots are for the same build: the layout and sizes must match.
+ */
+
+#define SNAPSHOT_MAGIC      "emJS"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_ENDIAN     0x01020304
+
+// The buffer starts at this offset, so that it is aligned in the mapping.
+#define SNAPSHOT_HEADER_SIZE    64
+
+struct snapshot_header_
+{
+    char magic[4];
+    uint16_t version;
+    uint8_t ptr_size;
+    uint8_t size_size;
+    uint32_t endian;
+    uint16_t header_size;	// sizeof(struct header_)
+    uint16_t entry_size;	// sizeof(struct entry_)
+    uint64_t base;			// address of the buffer when saved
+    uint64_t buf_size;
+};
+
+static int write_all_(int fd, const void *buf, size_t len);
+static int has_outside_refs_(json_t *obj);
+static int check_obj_(uint8_t *buf, uint64_t base, size_t off, size_t end, size_t depth);
+
+/*******************************************************************************
+ * Snapshot functions
+ ******************************************************************************/
+
+/*
+ * Write obj to fd as a snapshot. The buffer is saved up to its last used
+ * byte, so the loaded object has no free space. Linked children and
+ * borrowed strings are not in the buffer, so such an object cannot be saved.
+ */
+int json_snapshot_write(json_t *obj, int fd)
+{
+    if (has_outside_refs_(obj))
+    {
+        return JSON_ERROR;
+    }
+    uint8_t file_header[SNAPSHOT_HEADER_SIZE] = {0};
+    struct snapshot_header_ snapshot = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .ptr_size = sizeof(void *),
+        .size_size = sizeof(size_t),
+        .endian = SNAPSHOT_ENDIAN,
+        .header_size = sizeof(struct header_),
+        .entry_size = sizeof(struct entry_),
+        .base = (uintptr_t)obj->buf,
+        .buf_size = buf_idx_(obj)
+    };
+    memcpy(file_header, &snapshot, sizeof(snapshot));
+
+    // a root object of its own, trimmed
+    struct header_ header = *header_ptr_(obj);
+    header.parent = NULL;
+    header.parent_entry_idx = 0;
+    header.buf_size = buf_idx_(obj);
+
+    if (JSON_OK != write_all_(fd, file_header, sizeof(file_header)) ||
+        JSON_OK != write_all_(fd, &header, sizeof(header)) ||
+        JSON_OK != write_all_(fd, (uint8_t *)obj->buf + sizeof(header),
+                buf_idx_(obj) - sizeof(header)))
+    {
+        return JSON_ERROR;
+    }
+    return JSON_OK;
+}
+
+/*
+ * Map a snapshot file and return its object, or an object with a NULL
+ * buffer on failure. The object and its children are checked against the
+ * size of the file, then frozen: the pages are read-only, and the pages of
+ * the file are shared until the table is moved to the mapped address.
+ * Release it with json_snapshot_unmap().
+ */
+json_t json_snapshot_map(const char *path)
+{
+    json_t obj = {0};
+    struct snapshot_header_ snapshot;
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return obj;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < SNAPSHOT_HEADER_SIZE)
+    {
+        close(fd);
+        return obj;
+    }
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+    {
+        return obj;
+    }
+    memcpy(&snapshot, map, sizeof(snapshot));
+    if (0 != memcmp(snapshot.magic, SNAPSHOT_MAGIC, 4) ||
+        SNAPSHOT_VERSION != snapshot.version ||
+        sizeof(void *) != snapshot.ptr_size ||
+        sizeof(size_t) != snapshot.size_size ||
+        SNAPSHOT_ENDIAN != snapshot.endian ||
+        sizeof(struct header_) != snapshot.header_size ||
+        sizeof(struct entry_) != snapshot.entry_size ||
+        snapshot.buf_size < sizeof(struct header_) ||
+        snapshot.buf_size != (uint64_t)st.st_size - SNAPSHOT_HEADER_SIZE)
+    {
+        munmap(map, st.st_size);
+        return obj;
+    }
+    obj.buf = map + SNAPSHOT_HEADER_SIZE;
+    if (buf_size_(&obj) != snapshot.buf_size || NULL != parent_ptr_(&obj) ||
+        JSON_OK != check_obj_(obj.buf, snapshot.base, 0, snapshot.buf_size, 0))
+    {
+        munmap(map, st.st_size);
+        return (json_t){0};
+    }
+    json_relocate(&obj, (void *)(uintptr_t)snapshot.base);
+    json_freeze(&obj);
+    mprotect(map, st.st_size, PROT_READ);
+    return obj;
+}
+
+int json_snapshot_unmap(json_t *obj)
+{
+    if (NULL == obj->buf)
+    {
+        return JSON_ERROR;
+    }
+    uint8_t *map = (uint8_t *)obj->buf - SNAPSHOT_HEADER_SIZE;
+    munmap(map, SNAPSHOT_HEADER_SIZE + buf_size_(obj));
+    obj->buf = NULL;
+    return JSON_OK;
+}
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+
+static int write_all_(int fd, const void *buf, size_t len)
+{
+    const uint8_t *ptr = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, ptr, len);
+        if (n <= 0)
+        {
+            return JSON_ERROR;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return JSON_OK;
+}
+
+static int has_outside_refs_(json_t *obj)
+{
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        if (entry->flags & (ENTRY_LINKED_ | ENTRY_KEY_BORROWED_ | ENTRY_VALUE_BORROWED_))
+        {
+            return 1;
+        }
+        if (JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            if (has_outside_refs_(&child))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Check the object at offset off of a mapped snapshot buffer, whose
+ * pointers are still the ones of the buffer saved at base: its header and
+ * table are below end, and its keys, values and children are in its used
+ * content, nested at most JSON_INPUT_DEPTH deep. No cache has written the
+ * mapped object, so the changes saved with it are cleared.
+ */
+static int check_obj_(uint8_t *buf, uint64_t base, size_t off, size_t end, size_t depth)
+{
+    json_t obj = {
+            .buf = buf + off
+    };
+    if (depth >= JSON_INPUT_DEPTH ||
+        end - off < sizeof(struct header_) ||
+        buf_size_(&obj) > end - off ||
+        buf_idx_(&obj) > buf_size_(&obj) ||
+        0 == table_size_(&obj) ||
+        0 != (table_size_(&obj) & (table_size_(&obj) - 1)) ||
+        table_size_(&obj) > (buf_idx_(&obj) - sizeof(struct header_)) / sizeof(struct entry_))
+    {
+        return JSON_ERROR;
+    }
+    size_t content = off + sizeof(struct header_) + table_byte_size_(&obj);
+    size_t used = off + buf_idx_(&obj);
+    size_t count = 0;
+    header_flags_(&obj) &= ~HEADER_LAYOUT_CHANGED_;
+    for (size_t i = 0; i < table_size_(&obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(&obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        count += 1;
+        entry->flags &= ~ENTRY_DIRTY_;
+        // offsets of the key and the value, huge if they are below base
+        size_t key = (uintptr_t)entry->key - base;
+        size_t value = (uintptr_t)entry->value_ptr - base;
+        if (entry->flags & (ENTRY_LINKED_ | ENTRY_KEY_BORROWED_ | ENTRY_VALUE_BORROWED_ |
+                ENTRY_MOVING_) ||
+            key < content || key >= used || NULL == memchr(buf + key, '\0', used - key))
+        {
+            return JSON_ERROR;
+        }
+        switch (entry->value_type)
+        {
+        case JSON_INT:
+        case JSON_FLOAT:
+            if (value < content || value >= used || used - value < sizeof(int32_t))
+            {
+                return JSON_ERROR;
+            }
+            break;
+        case JSON_STRING:
+            if (value < content || value >= used ||
+                NULL == memchr(buf + value, '\0', used - value))
+            {
+                return JSON_ERROR;
+            }
+            break;
+        case JSON_OBJECT:
+            {
+                if (value < content || value >= used ||
+                    JSON_OK != check_obj_(buf, base, value, used, depth + 1))
+                {
+                    return JSON_ERROR;
+                }
+                json_t child = {
+                        .buf = buf + value
+                };
+                if (idx_in_parent_(&child) != i)
+                {
+                    return JSON_ERROR;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return (count == entry_count_(&obj)) ? JSON_OK : JSON_ERROR;
+}
+
+#endif
@@ -15,11 +15,36 @@ struct parser_result_
 static struct parser_result_ check_string_(char *input);
 static struct parser_result_ check_number_(char *input);
 
-static int insert_(json_t *obj, struct parser_result_ *key, struct parser_result_ *value);
+static int parse_(json_t *obj, char *input, char *stop, int borrow);
+static int insert_(json_t *obj, struct parser_result_ *key, struct parser_result_ *value,
+        int borrow);
+static void restore_input_(json_t *obj);
 
-static int is_ws_(char input);
 static inline int is_digit_(char input);
 
+/*
+ * Serializer-related functions
+ */
+static int write_obj_(json_out_t *out, json_t *obj, uint8_t flags, json_span_t *span);
+static int write_snapshot_(json_out_t *out, json_t *obj, uint8_t flags, json_span_t *span);
+static inline int write_value_(json_out_t *out, struct entry_ *entry, uint8_t flags);
+static int patch_value_(json_cache_t *cache, json_t *obj, size_t idx);
+static void clear_changed_(json_t *obj);
+static void write_(json_out_t *out, const char *src, size_t len);
+static inline void write_char_(json_out_t *out, char cha);
+static int writer_next_(json_writer_t *writer);
+
+/*
+ * Struct binding functions
+ */
+static int bind_obj_(const char **pos, uint8_t *dest, const json_desc_t *desc);
+static int bind_value_(const char **pos, uint8_t *dest, const json_field_t *field);
+static const json_field_t *find_field_(const json_desc_t *desc, size_t *next,
+        const char *key, size_t len);
+static int store_int_(uint8_t *ptr, size_t size, int64_t value);
+static int32_t load_int_(const uint8_t *ptr, size_t size);
+static int write_fields_(json_out_t *out, const uint8_t *src, const json_desc_t *desc);
+
 /*
  *  Converter-related structs and functions
  */
@@ -35,8 +60,9 @@ struct atox_ret_
 
 static struct atox_ret_ atoi_(const char *str);
 static struct atox_ret_ atof_(const char *str);
-static int itoa_(int input, char *str, int base);
+static int itoa_(int input, char *str);
 static int ftoa_(float input, char *str);
+static int utoa_(uint32_t input, char *str);
 
 /*******************************************************************************
  * Parser functions
@@ -44,12 +70,42 @@ static int ftoa_(float input, char *str);
 
 int json_parse(json_t *obj, char *input)
 {
-    enum
+    return parse_range_(obj, input, NULL, 0);
+}
+
+/*
+ * Like json_parse(), but keys and string values are not copied: the entries
+ * point into input, which must live as long as obj. The closing quote of
+ * each one is replaced by '\0', and put back if parsing fails. Parse into an
+ * empty object.
+ */
+int json_parse_borrowed(json_t *obj, char *input)
+{
+    return parse_range_(obj, input, NULL, 1);
+}
+
+/*
+ * Parse the members of an object into obj. input is at the object, or at a
+ * ',' before one of its members to parse a part of it; stop is then at the
+ * ',' or '}' after the last member of the part. stop is NULL to parse the
+ * object to its end.
+ */
+int parse_range_(json_t *obj, char *input, char *stop, int borrow)
+{
+    int ret = parse_(obj, input, stop, borrow);
+    if (ret < 0 && borrow)
     {
-        start, end, value, name
-    }state;
+        restore_input_(obj);
+    }
+    return ret;
+}
+
+static int parse_(json_t *obj, char *input, char *stop, int borrow)
+{
+    enum parse_state_ state;
     char *i = input;
-    if (strlen(input) < 2)
+    // not strlen(), which would go through the rest of the input each time
+    if ('\0' == input[0] || '\0' == input[1])
     {
         return JSON_ERROR;
     }
@@ -58,32 +114,39 @@ int json_parse(json_t *obj, char *input)
     {
         i += 1;
     }
-    if (*i != '{')
+    if (*i == '{')
+    {
+        state = parse_start_;
+    }
+    else if (*i == ',' && NULL != stop)
+    {
+        state = parse_name_;
+    }
+    else
     {
         return JSON_ERROR;
     }
     i += 1;
-    state = start;
     struct parser_result_ result_name;
     struct parser_result_ result_value;
     int ret;
-    while (end != state)
+    while (parse_end_ != state)
     {
         switch (state)
         {
-        case start:
+        case parse_start_:
             while (is_ws_(*i))
             {
                 i += 1;
             }
-            if (*i == '}')
+            if (*i == '}' && (NULL == stop || i == stop))
             {
-                state = end;
+                state = parse_end_;
                 continue;
             }
             else if (*i == '"')
             {
-                state = name;
+                state = parse_name_;
                 continue;
             }
             else
@@ -91,7 +154,7 @@ int json_parse(json_t *obj, char *input)
                 return JSON_ERROR;
             }
             break;
-        case name:
+        case parse_name_:
             while (is_ws_(*i))
             {
                 i += 1;
@@ -120,7 +183,7 @@ int json_parse(json_t *obj, char *input)
             if(*i == ':')
             {
                 i += 1;
-                state = value;
+                state = parse_value_;
                 continue;
             }
             else
@@ -128,7 +191,7 @@ int json_parse(json_t *obj, char *input)
                 return JSON_ERROR;
             }
             break;
-        case value:
+        case parse_value_:
             while (is_ws_(*i))
             {
                 i += 1;
@@ -144,6 +207,7 @@ int json_parse(json_t *obj, char *input)
             else if (*i == '{')
             {
             	result_value.i = i;
+            	result_value.j = i;
             	result_value.result_type = JSON_OBJECT;
             }
             else
@@ -151,16 +215,15 @@ int json_parse(json_t *obj, char *input)
                 return JSON_ERROR;
             }
             // put them into the object
-            ret = insert_(obj, &result_name, &result_value);
+            ret = insert_(obj, &result_name, &result_value, borrow);
             // update i
             i = result_value.j;
             if (JSON_OK != ret)
             {
                 return ret;
             }
-            // Then keep going
-            if (result_value.result_type == JSON_STRING &&
-                *i == '"')
+            // Then keep going. A borrowed string ends with '\0' now.
+            if (result_value.result_type == JSON_STRING)
             {
                 i += 1;
             }
@@ -168,15 +231,15 @@ int json_parse(json_t *obj, char *input)
             {
                 i += 1;
             }
-            if (*i == ',')
+            if (*i == ',' && i != stop)
             {
                 i += 1;
-                state = name;
+                state = parse_name_;
                 continue;
             }
-            else if (*i == '}')
+            else if (i == stop || (*i == '}' && NULL == stop))
             {
-                state = end;
+                state = parse_end_;
                 continue;
             }
             else
@@ -214,10 +277,13 @@ static struct parser_result_ check_string_(char *input)
     ret.i += 1; ret.j += 1;
     // from now i is fixed.
     // TODO: Detect also special characters (such as \")
-    while (*ret.j != '"')
-    {
-        ret.j += 1;
+    char *quote = strchr(ret.j, '"');
+    if (NULL == quote)
+    {   // not closed
+        ret.j += strlen(ret.j);
+        return ret;
     }
+    ret.j = quote;
     // Done. Success
     ret.result_type = JSON_STRING;
     return ret;
@@ -330,513 +396,1794 @@ static struct parser_result_ check_number_(char *input)
 }
 
 /*******************************************************************************
- * String-building functions
+ * Structural scan, for parsing in parts
  ******************************************************************************/
 
-int json_strcpy(char *dest, json_t *obj)
+// Characters the scans look at, so that the others cost one lookup.
+enum
 {
-    int idx = 0;
-    memset(dest + idx, '{', 1);
-    idx += 1;
-    // start
-    for (size_t i = 0; i < table_size_(obj); i++)
+    SCAN_OTHER_, SCAN_QUOTE_, SCAN_OPEN_, SCAN_CLOSE_, SCAN_COMMA_, SCAN_COLON_
+};
+static const uint8_t scan_class_[256] = {
+    ['"'] = SCAN_QUOTE_, ['{'] = SCAN_OPEN_, ['}'] = SCAN_CLOSE_,
+    [','] = SCAN_COMMA_, [':'] = SCAN_COLON_
+};
+
+/*
+ * The parser knows no escapes, so every '"' opens or closes a string. A
+ * range can be scanned before it is known whether it starts in a string:
+ * the change of depth is counted for both cases.
+ */
+void scan_range_(const char *begin, const char *end, struct scan_ *scan)
+{
+    size_t quotes = 0;
+    long depth[2] = {0, 0};
+    for (const char *i = begin; i < end; i++)
     {
-        struct entry_ entry = table_ptr_(obj)[i];
-        if (NULL == entry.key)
-        {    // empty entry
-            continue;
-        }
-        // copy key: "<key>":
-        memset(dest + idx, '\"', 1);
-        idx += 1;
-        int str_len = strlen(entry.key);
-        strcpy(dest + idx, entry.key);
-        strcpy(dest + idx + str_len, "\":");
-        idx += str_len + 2;
-        // copy value: "<value>",
-        switch (entry.value_type)
+        switch (scan_class_[(uint8_t)*i])
         {
-        case JSON_INT:
-        	str_len = itoa_(*(int *)entry.value_ptr, dest + idx, 10);
+        case SCAN_QUOTE_:
+            quotes += 1;
             break;
-        case JSON_FLOAT:
-#ifdef __CC_ARM
-        	// For the same problem in json_get_float();
-        	// The VLDR instruction causes hard fault....
-        	{
-        		float value;
-        		memcpy(&value, entry.value_ptr, sizeof(float));
-        		ftoa_(value, dest + idx);
-        		break;
-        	}
-#else	// __GNUC__
-        	str_len = ftoa_(*(float *)entry.value_ptr, dest + idx);
+        case SCAN_OPEN_:
+            depth[quotes & 1] += 1;
             break;
-#endif
-        case JSON_STRING:
-            memset(dest + idx, '\"', 1);
-            idx += 1;
-            strcpy(dest + idx, (char *)entry.value_ptr);
-            str_len = strlen(dest + idx);
+        case SCAN_CLOSE_:
+            depth[quotes & 1] -= 1;
             break;
-        case JSON_OBJECT:
-        	{
-        		json_t tmp = {
-        				.buf = entry.value_ptr
-        		};
-        		str_len = json_strcpy(dest + idx, &tmp);
-        	}
-        	break;
-        case JSON_NULL:
-            strcpy(dest + idx, "null");
-            str_len = 4;
-        	break;
         default:
-            return JSON_ERROR;
+            break;
         }
-        strcpy(dest + idx + str_len, (JSON_STRING == entry.value_type) ? "\"," : ",");
-        idx += str_len + ((JSON_STRING == entry.value_type)? 2 : 1);
     }
-    // it's the end
-    // -1 is to remove the last ','.
-    strcpy(dest + idx -1, "}");
-    return idx;
+    scan->quotes = quotes;
+    scan->depth[0] = depth[0];
+    scan->depth[1] = depth[1];
 }
 
-int json_strlen(json_t *obj)
+/*
+ * The first ',' between members of the outermost object in [begin, end),
+ * starting in a string or not and at depth. NULL if there is none or the
+ * object ends first.
+ */
+char *find_member_(char *begin, char *end, int in_string, long depth)
 {
-    char str_buf[30];   // FIXME: Take more string length
-    int idx = 0;
-    idx += 1;    // '{'
-    // start
-    for (size_t i = 0; i < table_size_(obj); i++)
+    char *i = begin;
+    if (in_string)
     {
-        struct entry_ entry = table_ptr_(obj)[i];
-        if (NULL == entry.key)
-        {    // empty entry
-            continue;
-        }
-        // "<key>":
-        idx += 1; // '\"'
-        int str_len = strlen(entry.key);
-        idx += str_len + 2;    // <key>":
-        // "<value>",
-        switch (entry.value_type)
+        i = memchr(i, '"', end - i);
+        i = (NULL == i) ? end : i + 1;
+    }
+    for (; i < end; i++)
+    {
+        switch (scan_class_[(uint8_t)*i])
         {
-        case JSON_INT:
-            str_len = itoa_(*(int *)entry.value_ptr, str_buf, 10);
+        case SCAN_QUOTE_:
+            // skip the string
+            i = memchr(i + 1, '"', end - i - 1);
+            if (NULL == i)
+            {
+                return NULL;
+            }
             break;
-        case JSON_FLOAT:
-#ifdef __CC_ARM
-        	// For the same problem in json_get_float();
-        	// The VLDR instruction causes hard fault....
-        	{
-        		float value;
-        		memcpy(&value, entry.value_ptr, sizeof(float));
-        		str_len = ftoa_(value, str_buf);
-        		break;
-        	}
-#else	// __GNUC__
-        	str_len = ftoa_(*(float *)entry.value_ptr, str_buf);
+        case SCAN_OPEN_:
+            depth += 1;
             break;
-#endif
-        case JSON_STRING:
-            idx += 1;    // '\"'
-            str_len = strlen((char *)entry.value_ptr);
+        case SCAN_CLOSE_:
+            if (--depth <= 0)
+            {
+                return NULL;
+            }
+            break;
+        case SCAN_COMMA_:
+            if (1 == depth)
+            {
+                return i;
+            }
             break;
-        case JSON_OBJECT:
-        	{
-        		json_t tmp = {
-        				.buf = entry.value_ptr
-        		};
-        		str_len = json_strlen(&tmp);
-        	}
-        	break;
-        case JSON_NULL:
-        	str_len = 4; // "null"
-        	break;
         default:
-            return JSON_ERROR;
+            break;
         }
-        idx += str_len + ((JSON_STRING == entry.value_type) ? 2 : 1); // <value>",
     }
-    // it's the end, '}'
-    // consider removing the last ','.
-    return idx;
+    return NULL;
 }
 
-static int insert_(json_t *obj, struct parser_result_ *key, struct parser_result_ *value)
+/*
+ * Count what a part of an object holds, from input as parse_range_() takes
+ * it to stop, so that its buffer is sized once.
+ */
+void count_part_(char *input, char *stop, struct part_count_ *count)
 {
-    // store the end character then delete
-    char name_end = *key->j;
-    char value_end = *value->j;
-    *key->j = '\0';
-    if (JSON_OBJECT != value->result_type)
-    {
-        *value->j = '\0';
-    }
-    // convert value.
-    union {
-    	int32_t i;
-    	float f;
-    	char *str;
-    	json_t obj;
-    } input;
-    int ret;
-    switch (value->result_type)
+    *count = (struct part_count_){0};
+    long depth = 1;
+    for (char *i = input + 1; i < stop; i++)
     {
-    case JSON_STRING:
-        input.str = value->i;
-        ret = json_insert(obj, key->i, input.str, value->result_type);
-        break;
-    case JSON_INT:
-        input.i = atoi_(value->i).value.i;
-        ret = json_insert(obj, key->i, &input.i, value->result_type);
-        break;
-    case JSON_FLOAT:
-        input.f = atof_(value->i).value.f;
-        ret = json_insert(obj, key->i, &input.f, value->result_type);
-        break;
-    case JSON_OBJECT:
-    	// FIXME: Find a better way
-    	/*
-    	 * Object insertion strategy:
-    	 * 1. Create a temporary object that takes over the rest of buffer.
-    	 * 2. Then insert.
-    	 * 3. Finally trim the buffer size of the child and move the index back.
-    	 */
-    	// Make NULL type insertion first?
-    	// what about inserting null object?
-        ret = json_insert_empty_obj(obj, key->i, buf_size_(obj)-(buf_idx_(obj)+strlen(key->i)+1));
-        input.obj = json_get_obj(obj, key->i);
-        if (NULL == input.obj.buf)
-        {
-        	return JSON_BUFFER_FULL;
-        }
-        value->j = value->i;
-        value->j += json_parse(&input.obj, value->i);
-        if (value->j < value->i)
-        {
-        	return (value->j < value->i); // convert into an error code.
-        }
-        // finally trim down the buffer
+        switch (scan_class_[(uint8_t)*i])
         {
-        	size_t offset = buf_size_(&input.obj) - buf_idx_(&input.obj);
-        	buf_size_(&input.obj) -= offset;
-        	buf_idx_(obj) -= offset;
-        	struct entry_ *tmp_entry = table_ptr_(obj) + idx_in_parent_(&input.obj);
-        	tmp_entry->value_size -= offset;
+        case SCAN_QUOTE_:
+            i = memchr(i + 1, '"', stop - i - 1);
+            if (NULL == i)
+            {
+                return;
+            }
+            break;
+        case SCAN_COLON_:
+            count->values += 1;
+            count->members += (1 == depth);
+            break;
+        case SCAN_OPEN_:
+            depth += 1;
+            count->objects += 1;
+            break;
+        case SCAN_CLOSE_:
+            depth -= 1;
+            break;
+        default:
+            break;
         }
-        break;
-    default:
-        return JSON_ERROR;
-    }
-    // restore charters
-    *key->j = name_end;
-
-    if (JSON_OBJECT != value->result_type)
-    {
-        *value->j = value_end;
     }
-    return ret;
 }
 
-
-static int is_ws_(char input)
+// The outermost braces of input, with nothing but whitespace around them.
+int outer_braces_(char *input, size_t len, char **open, char **close)
 {
-    if (input == 0x20 || input == 0x09      // space, horizontal tab
-        || input == 0x0a || input == 0x0d)  // LF/NL, CR
+    char *i = input;
+    char *j = input + len;
+    while (i < j && is_ws_(*i))
     {
-        return 1;
+        i += 1;
     }
-    else return 0;
-}
-
-static inline int is_digit_(char input)
-{
-    if (('0' <= input) && (input <= '9'))
+    while (j > i && is_ws_(j[-1]))
     {
-        return 1;
+        j -= 1;
     }
-    else return 0;
+    if (j - i < 2 || '{' != *i || '}' != j[-1])
+    {
+        return JSON_ERROR;
+    }
+    *open = i;
+    *close = j - 1;
+    return JSON_OK;
 }
 
 /*******************************************************************************
- * xtox funtions
+ * String-building functions
  ******************************************************************************/
 
-struct atox_ret_ atoi_(const char *str)
+int json_strcpy(char *dest, json_t *obj)
 {
-    struct atox_ret_ ret;
-    int ret_int = 0;
-    int8_t sign = 1;
-    unsigned int len = 0;
-    if (NULL == str)
-    {
-        return (struct atox_ret_){0};
-    }
-    if(*str == '-')
-    {
-        sign = -1;
-        str++;
-    }
-    for(;*str != '\0'; str++)
-    {
-        if (!(('0' <= *str) && (*str <= '9')))
-        {
-            break;
-        }
-        len += 1;
-        ret_int = ret_int * 10 + (*str - '0');
-    }
-    ret = (struct atox_ret_){
-        .value.i = ret_int * sign,
-        .str_len = len
+    json_out_t out = {
+        .buf = dest,
+        .size = (size_t)-1,
+        .len = 0,
+        .grow = NULL
     };
-    return ret;
+    return json_serialize(&out, obj);
 }
 
-struct atox_ret_ atof_(const char *str)
+int json_strncpy(char *dest, json_t *obj, size_t size)
 {
-    struct atox_ret_ ret;
-    struct atox_ret_ tmp;
-    uint8_t is_plus = 1;
-    int int_part = 0;    // integer part
-    float frac_part = 0;    // fraction part
-    size_t frac_len = 0;// length of fraction part
-    int expo_part = 0;    // exponent part
+    json_out_t out = {
+        .buf = dest,
+        .size = size,
+        .len = 0,
+        .grow = NULL
+    };
+    return json_serialize(&out, obj);
+}
 
-    unsigned int len = 0;
-    if (NULL == str)
-    {
-        return (struct atox_ret_){0};
-    }
-    // get integer part
-    if (*str == '-')
+int json_strlen(json_t *obj)
+{
+    // kept up to date by every change
+#ifdef JSON_HAS_ATOMIC
+    if (is_concurrent_(obj))
     {
-        is_plus = 0;
-        str += 1;
-        len += 1;
+        return __atomic_load_n(&str_len_(obj), __ATOMIC_RELAXED);
     }
-    tmp = atoi_(str);
-    int_part = tmp.value.i;
-
-    str += tmp.str_len;
-    len += tmp.str_len;
+#endif
+    return str_len_(obj);
+}
 
-    // get fraction part check
-    if(*str == '.')
+int json_serialize(json_out_t *out, json_t *obj)
+{
+    int ret = write_snapshot_(out, obj, 0, NULL);
+    // terminate what fits
+    if (out->size > 0)
     {
-        str += 1;
-        tmp = atoi_(str);
-        frac_part = (float) tmp.value.i;
-        frac_len = tmp.str_len;
-
-        str += tmp.str_len;
-        len += tmp.str_len + 1;
+        out->buf[(out->len < out->size) ? out->len : out->size - 1] = '\0';
     }
+    return (JSON_OK == ret) ? (int)out->len : ret;
+}
 
-    // exponent part
-    if (*str == 'e' ||
-        *str == 'E')
+int json_cache_init(json_cache_t *cache, char *buf, size_t size,
+		json_span_t *span, size_t span_count, uint8_t flags)
+{
+    if (NULL == buf || 0 == size)
     {
-        str += 1;
-        tmp = atoi_(str);
-        expo_part = tmp.value.i;
-
-        str += tmp.str_len;
-        len += tmp.str_len + 1;
+        return JSON_ERROR;
     }
+    *cache = (json_cache_t){
+        .buf = buf,
+        .size = size,
+        .len = 0,
+        .span = span,
+        .span_count = span_count,
+        .flags = flags
+    };
+    return JSON_OK;
+}
 
-    // put them together
-    ret.value.f = (float) int_part;
-    if (frac_len > 0)
+/*
+ * Like json_strcpy() into cache->buf, but only the values changed by
+ * json_set_*() since the last call are written again. Everything is written
+ * when entries were added or removed, and always for a concurrent object.
+ * A cache must be used for only one object. Returns the length of the output.
+ */
+int json_strcpy_cached(json_cache_t *cache, json_t *obj)
+{
+    int ret;
+    if (0 == cache->len ||
+        (header_flags_(obj) & (HEADER_LAYOUT_CHANGED_ | HEADER_CONCURRENT_)) ||
+        table_size_(obj) > cache->span_count)
     {
-        // add fraction
-        int frac_divisor = 1;
-        for(; frac_len > 0; frac_len--)
+        json_out_t out = {
+            .buf = cache->buf,
+            .size = cache->size,
+            .len = 0,
+            .grow = NULL
+        };
+        int has_span = (table_size_(obj) <= cache->span_count);
+        cache->len = 0;
+        ret = write_snapshot_(&out, obj, cache->flags, has_span ? cache->span : NULL);
+        if (JSON_OK != ret)
         {
-            frac_divisor *= 10;
+            return ret;
         }
-        frac_part /= frac_divisor;
-        if (ret.value.f < 0)
+        if (out.len >= out.size)
         {
-            ret.value.f *= -1;
-            ret.value.f += frac_part;
-            ret.value.f *= -1;
+            return JSON_BUFFER_FULL;
         }
-        else
+        cache->buf[out.len] = '\0';
+        cache->len = has_span ? out.len : 0;
+        clear_changed_(obj);
+        return out.len;
+    }
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key || !(entry->flags & ENTRY_DIRTY_))
         {
-            ret.value.f += frac_part;
+            continue;
+        }
+        ret = patch_value_(cache, obj, i);
+        if (JSON_OK != ret)
+        {   // write everything next time
+            cache->len = 0;
+            return ret;
         }
     }
+    return cache->len;
+}
 
-    if (expo_part != 0)
+/*
+ * Write obj. If span is given, the place of each value is stored in the
+ * element of the same table index.
+ */
+static int write_obj_(json_out_t *out, json_t *obj, uint8_t flags, json_span_t *span)
+{
+    int is_first = 1;
+    write_char_(out, '{');
+    for (size_t i = 0; i < table_size_(obj); i++)
     {
-        // multiply exponent
-        int expo_multiplier = 1;
-        int8_t expo_signed = 1;
-        if (expo_part < 0)
-        {
-            expo_part *= -1;
-            expo_signed = 0;
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {    // empty entry
+            continue;
         }
-        for(; expo_part > 0; expo_part--)
+        if (!is_first)
         {
-            expo_multiplier *= 10;
+            write_char_(out, ',');
         }
-        if (expo_signed)
+        is_first = 0;
+        // "<key>":
+        write_char_(out, '\"');
+        write_(out, entry->key, strlen(entry->key));
+        write_(out, "\":", 2);
+        // <value>
+        size_t start = out->len;
+        int ret = write_value_(out, entry, flags);
+        if (JSON_OK != ret)
         {
-            ret.value.f *= expo_multiplier;
+            return ret;
         }
-        else
+        if (NULL != span)
         {
-            ret.value.f /= expo_multiplier;
+            span[i].start = start;
+            span[i].len = out->len - start;
         }
     }
+    write_char_(out, '}');
+    return JSON_OK;
+}
 
-    if (!is_plus)
+/*
+ * Write obj as it is at one moment. Numbers of a concurrent object may be
+ * changed meanwhile; then it is written again.
+ */
+static int write_snapshot_(json_out_t *out, json_t *obj, uint8_t flags, json_span_t *span)
+{
+#ifdef JSON_HAS_ATOMIC
+    if (is_concurrent_(obj))
+    {
+        struct header_ *root = concurrent_root_(obj);
+        size_t start = out->len;
+        size_t seq;
+        int ret;
+        do
+        {
+            seq = seq_read_begin_(root);
+            out->len = start;
+            ret = write_obj_(out, obj, flags, span);
+        } while (seq_read_retry_(root, seq));
+        return ret;
+    }
+#endif
+    return write_obj_(out, obj, flags, span);
+}
+
+static inline int write_value_(json_out_t *out, struct entry_ *entry, uint8_t flags)
+{
+    static const char spaces[] = "               ";
+    char num_buf[24];
+    int len;
+    switch (entry->value_type)
+    {
+    case JSON_INT:
+        {   // memcpy() for the same reason as in json_get_float()
+            int value;
+            memcpy(&value, entry->value_ptr, sizeof(int));
+            len = itoa_(value, num_buf);
+            if (flags & JSON_CACHE_FIXED_WIDTH)
+            {   // as long as "-2147483648"
+                write_(out, spaces, 11 - len);
+            }
+            write_(out, num_buf, len);
+        }
+        break;
+    case JSON_FLOAT:
+        {
+            float value;
+            memcpy(&value, entry->value_ptr, sizeof(float));
+            len = ftoa_(value, num_buf);
+            if (flags & JSON_CACHE_FIXED_WIDTH)
+            {   // as long as the longest output of ftoa_()
+                write_(out, spaces, 15 - len);
+            }
+            write_(out, num_buf, len);
+        }
+        break;
+    case JSON_STRING:
+        write_char_(out, '\"');
+        write_(out, (char *)entry->value_ptr, strlen((char *)entry->value_ptr));
+        write_char_(out, '\"');
+        break;
+    case JSON_OBJECT:
+        {
+            json_t tmp = {
+                    .buf = entry->value_ptr
+            };
+            return write_obj_(out, &tmp, flags, NULL);
+        }
+    case JSON_NULL:
+        write_(out, "null", 4);
+        break;
+    default:
+        return JSON_ERROR;
+    }
+    return JSON_OK;
+}
+
+size_t value_strlen_(json_type_t type, void *value_ptr)
+{
+    char num_buf[24];
+    switch (type)
+    {
+    case JSON_INT:
+        {
+            int value;
+            memcpy(&value, value_ptr, sizeof(int));
+            return itoa_(value, num_buf);
+        }
+    case JSON_FLOAT:
+        {
+            float value;
+            memcpy(&value, value_ptr, sizeof(float));
+            return ftoa_(value, num_buf);
+        }
+    case JSON_STRING:
+        return strlen((char *)value_ptr) + 2;
+    case JSON_OBJECT:
+        return ((struct header_ *)value_ptr)->str_len;
+    case JSON_NULL:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Write a changed value over its old place in the cached output. The rest
+ * of the output is moved only if the length is different.
+ */
+static int patch_value_(json_cache_t *cache, json_t *obj, size_t idx)
+{
+    struct entry_ *entry = table_ptr_(obj) + idx;
+    json_span_t *span = cache->span + idx;
+
+    // measure first
+    json_out_t out = {0};
+    int ret = write_value_(&out, entry, cache->flags);
+    if (JSON_OK != ret)
+    {
+        return ret;
+    }
+    size_t len = out.len;
+    if (len != span->len)
+    {
+        size_t tail = span->start + span->len;
+        if (cache->len - span->len + len >= cache->size)
+        {
+            return JSON_BUFFER_FULL;
+        }
+        // move the rest including '\0'
+        memmove(cache->buf + span->start + len, cache->buf + tail, cache->len - tail + 1);
+        for (size_t i = 0; i < table_size_(obj); i++)
+        {
+            if (NULL != table_ptr_(obj)[i].key && cache->span[i].start > span->start)
+            {
+                cache->span[i].start = cache->span[i].start - span->len + len;
+            }
+        }
+        cache->len = cache->len - span->len + len;
+        span->len = len;
+    }
+    out = (json_out_t){
+        .buf = cache->buf + span->start,
+        .size = len + 1,	// write_() keeps a byte for '\0'
+        .len = 0,
+        .grow = NULL
+    };
+    write_value_(&out, entry, cache->flags);
+    if (!is_frozen_(obj))
+    {   // a frozen object may be read by other threads, so it is written again
+        entry->flags &= ~ENTRY_DIRTY_;
+    }
+    if (JSON_OBJECT == entry->value_type)
+    {
+        json_t child = {
+                .buf = entry->value_ptr
+        };
+        clear_changed_(&child);
+    }
+    return JSON_OK;
+}
+
+// Forget the changes of obj and its children, as they are written.
+static void clear_changed_(json_t *obj)
+{
+    if (is_frozen_(obj))
+    {   // nothing to forget, and it may be read by other threads
+        return;
+    }
+    header_flags_(obj) &= ~HEADER_LAYOUT_CHANGED_;
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        entry->flags &= ~ENTRY_DIRTY_;
+        if (NULL != entry->key && JSON_OBJECT == entry->value_type)
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            clear_changed_(&child);
+        }
+    }
+}
+
+static void write_(json_out_t *out, const char *src, size_t len)
+{
+    // keep one byte for '\0'
+    size_t required = out->len + len + 1;
+    if (required > out->size && NULL != out->grow)
+    {
+        out->grow(out, required);
+    }
+    if (required <= out->size)
+    {
+        memcpy(out->buf + out->len, src, len);
+    }
+    else if (out->len + 1 < out->size)
+    {   // truncate
+        memcpy(out->buf + out->len, src, out->size - out->len - 1);
+    }
+    out->len += len;
+}
+
+static inline void write_char_(json_out_t *out, char cha)
+{
+    if (out->len + 1 < out->size)
+    {
+        out->buf[out->len] = cha;
+        out->len += 1;
+        return;
+    }
+    write_(out, &cha, 1);
+}
+
+/*
+ * Resumable serializer
+ * The output is cut into pieces (tokens, keys and values). Keys and string
+ * values are written from the object buffer as they are.
+ */
+enum
+{
+    writer_open, writer_key_open, writer_key, writer_colon, writer_value,
+    writer_str, writer_str_close, writer_next, writer_close, writer_done
+};
+
+int json_writer_init(json_writer_t *writer, json_t *obj)
+{
+    if (NULL == obj->buf)
+    {
+        return JSON_ERROR;
+    }
+    writer->depth = 0;
+    writer->frame[0].buf = obj->buf;
+    writer->frame[0].idx = 0;
+    writer->frame[0].is_first = 1;
+    writer->state = writer_open;
+    writer->piece = NULL;
+    writer->piece_len = 0;
+    writer->piece_idx = 0;
+    writer->gen_len = 0;
+    return JSON_OK;
+}
+
+/*
+ * Write at most cap bytes of the object. Call it again to continue where it
+ * stopped. Returns the number of bytes written, 0 when everything is written.
+ * The output is not null-terminated and the object must not be changed until
+ * it is done.
+ */
+int json_write_chunk(json_writer_t *writer, char *out, size_t cap)
+{
+    size_t len = 0;
+    while (len < cap)
+    {
+        if (writer->piece_idx >= writer->piece_len)
+        {
+            int ret = writer_next_(writer);
+            if (ret <= 0)
+            {
+                return (ret < 0) ? ret : (int)len;
+            }
+        }
+        size_t n = writer->piece_len - writer->piece_idx;
+        if (n > cap - len)
+        {
+            n = cap - len;
+        }
+        memcpy(out + len, writer->piece + writer->piece_idx, n);
+        writer->piece_idx += n;
+        len += n;
+    }
+    return (int)len;
+}
+
+/*
+ * Fill iov with the next part of the object without copying keys and string
+ * values: the vectors point into the object buffer. Quotes, colons, numbers
+ * and short strings are copied into side_buf. Call it again to continue.
+ * Returns the number of vectors filled, 0 when everything is written.
+ */
+int json_to_iovec(json_writer_t *writer, json_iovec_t *iov, int iov_count,
+        char *side_buf, size_t side_size)
+{
+    int count = 0;
+    size_t side_len = 0;
+    while (1)
+    {
+        if (writer->piece_idx >= writer->piece_len)
+        {
+            int ret = writer_next_(writer);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            if (0 == ret)
+            {
+                break;
+            }
+        }
+        const char *src = writer->piece + writer->piece_idx;
+        size_t len = writer->piece_len - writer->piece_idx;
+        if (writer->piece_is_ref && len >= JSON_IOVEC_MIN_REF)
+        {
+            if (count >= iov_count)
+            {
+                break;
+            }
+            iov[count].iov_base = (void *)src;
+            iov[count].iov_len = len;
+            count++;
+        }
+        else
+        {
+            if (side_len + len > side_size)
+            {
+                break;
+            }
+            // extend the last vector if it ends where this one starts
+            if (count > 0 &&
+                (char *)iov[count - 1].iov_base + iov[count - 1].iov_len == side_buf + side_len)
+            {
+                iov[count - 1].iov_len += len;
+            }
+            else if (count < iov_count)
+            {
+                iov[count].iov_base = side_buf + side_len;
+                iov[count].iov_len = len;
+                count++;
+            }
+            else
+            {
+                break;
+            }
+            memcpy(side_buf + side_len, src, len);
+            side_len += len;
+        }
+        writer->piece_idx = writer->piece_len;
+    }
+    if (0 == count && writer->piece_idx < writer->piece_len)
+    {   // not even a piece fits
+        return JSON_BUFFER_FULL;
+    }
+    return count;
+}
+
+/*
+ * Move to the next piece. Returns 1 if there is one, 0 when done.
+ * Keys and string values are pieces of their own. Everything between them
+ * is generated into writer->gen and given as one piece.
+ */
+static int writer_next_(json_writer_t *writer)
+{
+    writer->piece_idx = 0;
+    writer->piece_len = 0;
+    writer->piece_is_ref = 0;
+    while (1)
+    {
+        json_t obj = {
+                .buf = writer->frame[writer->depth].buf
+        };
+        size_t idx = writer->frame[writer->depth].idx;
+        struct entry_ *entry = table_ptr_(&obj) + idx;
+        char *gen = writer->gen + writer->gen_len;
+        switch (writer->state)
+        {
+        case writer_open:
+            *gen = '{';
+            writer->gen_len += 1;
+            writer->state = writer_key_open;
+            continue;
+        case writer_key_open:
+            // find the next entry
+            for (; idx < table_size_(&obj); idx++, entry++)
+            {
+                if (NULL != entry->key)
+                {
+                    break;
+                }
+            }
+            writer->frame[writer->depth].idx = idx;
+            if (idx >= table_size_(&obj))
+            {
+                *gen = '}';
+                writer->gen_len += 1;
+                writer->state = writer_close;
+                continue;
+            }
+            if (!writer->frame[writer->depth].is_first)
+            {
+                *gen++ = ',';
+                writer->gen_len += 1;
+            }
+            *gen = '\"';
+            writer->gen_len += 1;
+            writer->state = writer_key;
+            continue;
+        case writer_key:
+            if (writer->gen_len > 0)
+            {
+                break;
+            }
+            writer->piece = entry->key;
+            writer->piece_len = strlen(entry->key);
+            writer->piece_is_ref = 1;
+            writer->state = writer_colon;
+            return 1;
+        case writer_colon:
+            memcpy(gen, "\":", 2);
+            writer->gen_len += 2;
+            writer->state = writer_value;
+            continue;
+        case writer_value:
+            writer->state = writer_next;
+            switch (entry->value_type)
+            {
+            case JSON_INT:
+                {   // memcpy() for the same reason as in json_get_float()
+                    int value;
+                    memcpy(&value, entry->value_ptr, sizeof(int));
+                    writer->gen_len += itoa_(value, gen);
+                }
+                continue;
+            case JSON_FLOAT:
+                {
+                    float value;
+                    memcpy(&value, entry->value_ptr, sizeof(float));
+                    writer->gen_len += ftoa_(value, gen);
+                }
+                continue;
+            case JSON_STRING:
+                *gen = '\"';
+                writer->gen_len += 1;
+                writer->state = writer_str;
+                continue;
+            case JSON_OBJECT:
+                if (writer->depth + 1 >= JSON_WRITER_DEPTH)
+                {
+                    return JSON_ERROR;
+                }
+                writer->depth += 1;
+                writer->frame[writer->depth].buf = entry->value_ptr;
+                writer->frame[writer->depth].idx = 0;
+                writer->frame[writer->depth].is_first = 1;
+                writer->state = writer_open;
+                continue;
+            case JSON_NULL:
+                memcpy(gen, "null", 4);
+                writer->gen_len += 4;
+                continue;
+            default:
+                return JSON_ERROR;
+            }
+        case writer_str:
+            if (writer->gen_len > 0)
+            {
+                break;
+            }
+            writer->piece = (char *)entry->value_ptr;
+            writer->piece_len = strlen(writer->piece);
+            writer->piece_is_ref = 1;
+            writer->state = writer_str_close;
+            return 1;
+        case writer_str_close:
+            *gen = '\"';
+            writer->gen_len += 1;
+            writer->state = writer_next;
+            continue;
+        case writer_next:
+            writer->frame[writer->depth].idx += 1;
+            writer->frame[writer->depth].is_first = 0;
+            writer->state = writer_key_open;
+            continue;
+        case writer_close:
+            if (0 == writer->depth)
+            {
+                writer->state = writer_done;
+                continue;
+            }
+            // back to the parent
+            writer->depth -= 1;
+            writer->state = writer_next;
+            continue;
+        case writer_done:
+            if (writer->gen_len > 0)
+            {
+                break;
+            }
+            return 0;
+        default:
+            return JSON_ERROR;
+        }
+        // give out what is generated
+        writer->piece = writer->gen;
+        writer->piece_len = writer->gen_len;
+        writer->gen_len = 0;
+        return 1;
+    }
+}
+
+/*******************************************************************************
+ * Struct binding
+ ******************************************************************************/
+
+/*
+ * Parse an object of input straight into the fields of dest, as desc tells.
+ * Keys without a field are skipped, and fields without a key are left as
+ * they are. An int field takes only integers; a float field takes any
+ * number. Returns the length of the object parsed, or an error code.
+ */
+int json_parse_into(void *dest, const json_desc_t *desc, const char *input)
+{
+    const char *i = input;
+    int ret = bind_obj_(&i, dest, desc);
+    return (JSON_OK == ret) ? (int)(i - input) : ret;
+}
+
+/*
+ * Write the fields of src as an object, in the order of desc, like
+ * json_serialize() writes an object. Returns the length of the output.
+ */
+int json_write_from(const void *src, const json_desc_t *desc, json_out_t *out)
+{
+    int ret = write_fields_(out, src, desc);
+    // terminate what fits
+    if (out->size > 0)
+    {
+        out->buf[(out->len < out->size) ? out->len : out->size - 1] = '\0';
+    }
+    return (JSON_OK == ret) ? (int)out->len : ret;
+}
+
+// Parse an object at *pos, and skip it if desc is NULL.
+static int bind_obj_(const char **pos, uint8_t *dest, const json_desc_t *desc)
+{
+    const char *i = *pos;
+    size_t next = 0;
+    while (is_ws_(*i))
+    {
+        i += 1;
+    }
+    if (*i != '{')
+    {
+        return JSON_ERROR;
+    }
+    i += 1;
+    while (is_ws_(*i))
+    {
+        i += 1;
+    }
+    if (*i == '}')
+    {
+        *pos = i + 1;
+        return JSON_OK;
+    }
+    while (1)
+    {
+        while (is_ws_(*i))
+        {
+            i += 1;
+        }
+        if (*i != '"')
+        {
+            return JSON_ERROR;
+        }
+        const char *key = i + 1;
+        const char *key_end = strchr(key, '"');
+        if (NULL == key_end)
+        {
+            return JSON_ERROR;
+        }
+        i = key_end + 1;
+        while (is_ws_(*i))
+        {
+            i += 1;
+        }
+        if (*i != ':')
+        {
+            return JSON_ERROR;
+        }
+        i += 1;
+        while (is_ws_(*i))
+        {
+            i += 1;
+        }
+        const json_field_t *field = (NULL != desc) ?
+                find_field_(desc, &next, key, key_end - key) : NULL;
+        int ret = bind_value_(&i, dest, field);
+        if (JSON_OK != ret)
+        {
+            return ret;
+        }
+        while (is_ws_(*i))
+        {
+            i += 1;
+        }
+        if (*i == ',')
+        {
+            i += 1;
+            continue;
+        }
+        if (*i == '}')
+        {
+            *pos = i + 1;
+            return JSON_OK;
+        }
+        return JSON_ERROR;
+    }
+}
+
+// Parse the value at *pos into field of dest, or skip it if field is NULL.
+static int bind_value_(const char **pos, uint8_t *dest, const json_field_t *field)
+{
+    const char *i = *pos;
+    if (*i == '"')
+    {
+        const char *end = strchr(i + 1, '"');
+        if (NULL == end)
+        {
+            return JSON_ERROR;
+        }
+        *pos = end + 1;
+        if (NULL == field)
+        {
+            return JSON_OK;
+        }
+        if (JSON_STRING != field->type)
+        {
+            return JSON_TYPE_MISMATCH;
+        }
+        size_t len = end - (i + 1);
+        if (len >= field->size)
+        {
+            return JSON_BUFFER_FULL;
+        }
+        memcpy(dest + field->offset, i + 1, len);
+        dest[field->offset + len] = '\0';
+        return JSON_OK;
+    }
+    if (*i == '{')
+    {
+        if (NULL == field)
+        {
+            return bind_obj_(pos, NULL, NULL);
+        }
+        if (JSON_OBJECT != field->type)
+        {
+            return JSON_TYPE_MISMATCH;
+        }
+        return bind_obj_(pos, dest + field->offset, field->desc);
+    }
+    if (*i != '-' && !is_digit_(*i))
+    {
+        return JSON_ERROR;
+    }
+    const char *end = check_number_((char *)i).j;
+    *pos = end;
+    if (NULL == field)
+    {
+        return JSON_OK;
+    }
+    switch (field->type)
+    {
+    case JSON_INT:
+        {   // check_number_() takes "0" as a float, so look at the text. The
+            // value is read here, as atoi_() would wrap around past int32_t.
+            int64_t value = 0;
+            for (const char *j = (*i == '-') ? i + 1 : i; j < end; j++)
+            {
+                if (!is_digit_(*j))
+                {
+                    return JSON_TYPE_MISMATCH;
+                }
+                if (value <= INT32_MAX)
+                {   // more digits are out of range anyway
+                    value = value * 10 + (*j - '0');
+                }
+            }
+            return store_int_(dest + field->offset, field->size, (*i == '-') ? -value : value);
+        }
+    case JSON_FLOAT:
+        if (sizeof(float) != field->size)
+        {   // a double would be given a float silently
+            return JSON_ERROR;
+        }
+        *(float *)(dest + field->offset) = atof_(i).value.f;
+        return JSON_OK;
+    default:
+        return JSON_TYPE_MISMATCH;
+    }
+}
+
+// Fields are looked for from the one after the last found, as keys usually
+// come in the same order.
+static const json_field_t *find_field_(const json_desc_t *desc, size_t *next,
+        const char *key, size_t len)
+{
+    for (size_t n = 0; n < desc->count; n++)
+    {
+        size_t idx = *next + n;
+        idx = (idx < desc->count) ? idx : idx - desc->count;
+        const json_field_t *field = desc->fields + idx;
+        if (field->key_len == len && 0 == memcmp(field->key, key, len))
+        {
+            *next = idx + 1;
+            return field;
+        }
+    }
+    return NULL;
+}
+
+// JSON_ERROR if value does not fit in an integer of size bytes.
+static int store_int_(uint8_t *ptr, size_t size, int64_t value)
+{
+    switch (size)
+    {
+    case sizeof(int8_t):
+        if (value < INT8_MIN || value > INT8_MAX)
+        {
+            return JSON_ERROR;
+        }
+        *(int8_t *)ptr = value;
+        return JSON_OK;
+    case sizeof(int16_t):
+        if (value < INT16_MIN || value > INT16_MAX)
+        {
+            return JSON_ERROR;
+        }
+        *(int16_t *)ptr = value;
+        return JSON_OK;
+    case sizeof(int32_t):
+        if (value < INT32_MIN || value > INT32_MAX)
+        {
+            return JSON_ERROR;
+        }
+        *(int32_t *)ptr = value;
+        return JSON_OK;
+    default:	// numbers are int32_t: no 64-bit fields
+        return JSON_ERROR;
+    }
+}
+
+static int32_t load_int_(const uint8_t *ptr, size_t size)
+{
+    switch (size)
+    {
+    case sizeof(int8_t):
+        return *(const int8_t *)ptr;
+    case sizeof(int16_t):
+        return *(const int16_t *)ptr;
+    default:
+        return *(const int32_t *)ptr;
+    }
+}
+
+static int write_fields_(json_out_t *out, const uint8_t *src, const json_desc_t *desc)
+{
+    char num_buf[24];
+    write_char_(out, '{');
+    for (size_t n = 0; n < desc->count; n++)
+    {
+        const json_field_t *field = desc->fields + n;
+        const uint8_t *ptr = src + field->offset;
+        if (n > 0)
+        {
+            write_char_(out, ',');
+        }
+        write_char_(out, '\"');
+        write_(out, field->key, field->key_len);
+        write_(out, "\":", 2);
+        switch (field->type)
+        {
+        case JSON_INT:
+            if (sizeof(int8_t) != field->size && sizeof(int16_t) != field->size &&
+                sizeof(int32_t) != field->size)
+            {
+                return JSON_ERROR;
+            }
+            write_(out, num_buf, itoa_(load_int_(ptr, field->size), num_buf));
+            break;
+        case JSON_FLOAT:
+            if (sizeof(float) != field->size)
+            {
+                return JSON_ERROR;
+            }
+            write_(out, num_buf, ftoa_(*(const float *)ptr, num_buf));
+            break;
+        case JSON_STRING:
+            {   // a full array has no '\0'
+                const char *end = memchr(ptr, '\0', field->size);
+                write_char_(out, '\"');
+                write_(out, (const char *)ptr,
+                        (NULL != end) ? (size_t)(end - (const char *)ptr) : field->size);
+                write_char_(out, '\"');
+            }
+            break;
+        case JSON_OBJECT:
+            {
+                if (NULL == field->desc)
+                {
+                    return JSON_ERROR;
+                }
+                int ret = write_fields_(out, ptr, field->desc);
+                if (JSON_OK != ret)
+                {
+                    return ret;
+                }
+            }
+            break;
+        default:
+            return JSON_ERROR;
+        }
+    }
+    write_char_(out, '}');
+    return JSON_OK;
+}
+
+static int insert_(json_t *obj, struct parser_result_ *key, struct parser_result_ *value,
+        int borrow)
+{
+    // store the end character then delete
+    char name_end = *key->j;
+    char value_end = *value->j;
+    *key->j = '\0';
+    if (JSON_OBJECT != value->result_type)
+    {
+        *value->j = '\0';
+    }
+    // convert value.
+    union {
+    	int32_t i;
+    	float f;
+    	char *str;
+    	json_t obj;
+    } input;
+    int ret;
+    switch (value->result_type)
+    {
+    case JSON_STRING:
+        input.str = value->i;
+        ret = borrow ?
+                insert_borrowed_(obj, key->i, input.str, value->j - value->i + 1, JSON_STRING) :
+                json_insert(obj, key->i, input.str, value->result_type);
+        break;
+    case JSON_INT:
+        input.i = atoi_(value->i).value.i;
+        ret = borrow ?
+                insert_borrowed_(obj, key->i, &input.i, sizeof(int32_t), JSON_INT) :
+                json_insert(obj, key->i, &input.i, value->result_type);
+        break;
+    case JSON_FLOAT:
+        input.f = atof_(value->i).value.f;
+        ret = borrow ?
+                insert_borrowed_(obj, key->i, &input.f, sizeof(float), JSON_FLOAT) :
+                json_insert(obj, key->i, &input.f, value->result_type);
+        break;
+    case JSON_OBJECT:
+    	// FIXME: Find a better way
+    	/*
+    	 * Object insertion strategy:
+    	 * 1. Create a temporary object that takes over the rest of buffer.
+    	 * 2. Then insert.
+    	 * 3. Finally trim the buffer size of the child and move the index back.
+    	 */
+    	// Make NULL type insertion first?
+    	// what about inserting null object?
+        {	// the rest after the key and the padding, which may not even fit
+        	size_t used = buf_idx_(obj) + strlen(key->i) + 1;
+        	used += value_pad_(used, JSON_OBJECT);
+        	ret = json_insert_empty_obj(obj, key->i,
+        			(used < buf_size_(obj)) ? buf_size_(obj) - used : 0);
+        }
+        input.obj = json_get_obj(obj, key->i);
+        value->j = value->i;
+        if (NULL == input.obj.buf)
+        {
+        	ret = (JSON_OK != ret) ? ret : JSON_BUFFER_FULL;
+        	break;
+        }
+        int len = parse_(&input.obj, value->i, NULL, borrow);
+        while (JSON_TABLE_FULL == len)
+        {	// the child has the rest of the buffer, so its table grows there
+        	if (borrow)
+        	{
+        		restore_input_(&input.obj);
+        	}
+        	json_clear(&input.obj);
+        	len = json_double_table(&input.obj);
+        	if (JSON_OK == len)
+        	{
+        		len = parse_(&input.obj, value->i, NULL, borrow);
+        	}
+        }
+        if (len < 0)
+        {
+        	ret = len;
+        	break;
+        }
+        value->j += len;
+        // finally trim down the buffer
+        {
+        	size_t offset = buf_size_(&input.obj) - buf_idx_(&input.obj);
+        	buf_size_(&input.obj) -= offset;
+        	buf_idx_(obj) -= offset;
+        	struct entry_ *tmp_entry = table_ptr_(obj) + idx_in_parent_(&input.obj);
+        	tmp_entry->value_size -= offset;
+        }
+        break;
+    default:
+        return JSON_ERROR;
+    }
+    // restore charters, except the ends of what is borrowed.
+    // Object keys are copied.
+    int keep = borrow && JSON_OK == ret;
+    if (!keep || JSON_OBJECT == value->result_type)
+    {
+        *key->j = name_end;
+    }
+    if (JSON_OBJECT != value->result_type && !(keep && JSON_STRING == value->result_type))
     {
-        ret.value.f *= -1;
+        *value->j = value_end;
     }
-    // done
-    ret.str_len = len;
     return ret;
 }
 
-static int itoa_(int input, char *str, int base)
+// Put back the closing quotes json_parse_borrowed() replaced in the input.
+static void restore_input_(json_t *obj)
 {
-    unsigned int n = 0;
-    int d = 1;
-    if (input < 0)
+    for (size_t i = 0; i < table_size_(obj); i++)
+    {
+        struct entry_ *entry = table_ptr_(obj) + i;
+        if (NULL == entry->key)
+        {
+            continue;
+        }
+        if (entry->flags & ENTRY_KEY_BORROWED_)
+        {
+            entry->key[strlen(entry->key)] = '"';
+        }
+        if (entry->flags & ENTRY_VALUE_BORROWED_)
+        {
+            char *str = entry->value_ptr;
+            str[strlen(str)] = '"';
+        }
+        if (JSON_OBJECT == entry->value_type && !(entry->flags & ENTRY_LINKED_))
+        {
+            json_t child = {
+                    .buf = entry->value_ptr
+            };
+            restore_input_(&child);
+        }
+    }
+}
+
+
+int is_ws_(char input)
+{
+    if (input == 0x20 || input == 0x09      // space, horizontal tab
+        || input == 0x0a || input == 0x0d)  // LF/NL, CR
+    {
+        return 1;
+    }
+    else return 0;
+}
+
+static inline int is_digit_(char input)
+{
+    if (('0' <= input) && (input <= '9'))
+    {
+        return 1;
+    }
+    else return 0;
+}
+
+/*******************************************************************************
+ * xtox funtions
+ ******************************************************************************/
+
+struct atox_ret_ atoi_(const char *str)
+{
+    struct atox_ret_ ret;
+    int ret_int = 0;
+    int8_t sign = 1;
+    unsigned int len = 0;
+    if (NULL == str)
     {
-        *str++ = '-';
-        input *= -1;
-        n++;
+        return (struct atox_ret_){0};
     }
-    while((input / d) >= base)
+    if(*str == '-')
     {
-        d *= base;
+        sign = -1;
+        str++;
     }
-    while (d != 0)
+    for(;*str != '\0'; str++)
     {
-        int digit = input / d;
-        input %= d;
-        d /= base;
-        if (n || digit > 0 || d == 0)
+        if (!(('0' <= *str) && (*str <= '9')))
         {
-            *str++ = digit + ((digit < 10)? '0': 'a' - 10);
-            n++;
+            break;
         }
+        len += 1;
+        ret_int = ret_int * 10 + (*str - '0');
     }
-    *str = '\0';
-    return n;
+    ret = (struct atox_ret_){
+        .value.i = ret_int * sign,
+        .str_len = len
+    };
+    return ret;
 }
 
-static int ftoa_(float value, char* str)
+// Decimal exponents atof_() keeps. 1e9 * 1e60 is inf, and 1e9 / 1e60 is 0,
+// as floats.
+#define ATOF_EXPO_LIMIT    60
+
+struct atox_ret_ atof_(const char *str)
 {
-    union
+    struct atox_ret_ ret;
+    const char *start = str;
+    uint8_t is_plus = 1;
+    uint32_t digits = 0;    // significant digits. 9 digits are enough for float.
+    uint8_t digits_len = 0;
+    int expo_part = 0;    // decimal exponent of digits
+
+    if (NULL == str)
+    {
+        return (struct atox_ret_){0};
+    }
+    if (*str == '-')
+    {
+        is_plus = 0;
+        str += 1;
+    }
+    // integer part
+    for (; is_digit_(*str); str++)
     {
-        float f;
-        struct
+        if (digits_len < 9)
         {
-            uint16_t    mantissa_lo : 16;
-            uint16_t    mantissa_hi : 7;
-            uint16_t    exponent : 8;
-            uint8_t     sign : 1;
-        } bits;
-    } input;
-    uint32_t significand;
-    uint32_t int_part;
-    uint32_t frac_part;
-    int16_t exponent;
-    char *p;
+            digits = digits * 10 + (*str - '0');
+            digits_len += (digits > 0);
+        }
+        else
+        {
+            expo_part += 1;
+        }
+    }
+    // fraction part
+    if (*str == '.')
+    {
+        for (str++; is_digit_(*str); str++)
+        {
+            if (digits_len < 9)
+            {
+                digits = digits * 10 + (*str - '0');
+                digits_len += (digits > 0);
+                expo_part -= 1;
+            }
+        }
+    }
+    // exponent part, saturated so that it cannot overflow
+    if (*str == 'e' ||
+        *str == 'E')
+    {
+        int expo = 0;
+        int expo_sign = 1;
+        str += 1;
+        if (*str == '-' || *str == '+')
+        {
+            expo_sign = (*str == '-') ? -1 : 1;
+            str += 1;
+        }
+        for (; is_digit_(*str); str++)
+        {
+            expo = (expo < ATOF_EXPO_LIMIT) ? expo * 10 + (*str - '0') : ATOF_EXPO_LIMIT;
+        }
+        expo_part += expo_sign * expo;
+    }
+    // past it, 9 digits are inf or 0 as a float anyway
+    if (expo_part > ATOF_EXPO_LIMIT || expo_part < -ATOF_EXPO_LIMIT)
+    {
+        expo_part = (expo_part < 0) ? -ATOF_EXPO_LIMIT : ATOF_EXPO_LIMIT;
+    }
+
+    // put them together, scaled by the powers of 10 of the bits of the
+    // exponent. Powers of 10 up to 1e22 are exact in double, so are their products.
+    static const double pow10_[] = {1e1, 1e2, 1e4, 1e8, 1e16, 1e32};
+    double value = digits;
+    double scale = 1;
+    unsigned int expo_bits = (expo_part < 0) ? -expo_part : expo_part;
+    for (int bit = 0; expo_bits > 0; bit++, expo_bits >>= 1)
+    {
+        if (expo_bits & 1)
+        {
+            scale *= pow10_[bit];
+        }
+    }
+    value = (expo_part < 0) ? (value / scale) : (value * scale);
 
+    ret.value.f = (float)(is_plus ? value : -value);
+    ret.str_len = str - start;
+    return ret;
+}
 
-    if (value == (float)0.0)
+/*
+ * A null-terminated number as the parser reads it: JSON_INT or JSON_FLOAT,
+ * with the value in *value, or JSON_UNKNOWN if str is not all a number.
+ */
+json_type_t number_value_(char *str, void *value)
+{
+    struct parser_result_ number = check_number_(str);
+    if (JSON_UNKNOWN == number.result_type || '\0' != *number.j)
     {
-        strcpy(str, "0,0");
-        return 1;
+        return JSON_UNKNOWN;
+    }
+    if (JSON_INT == number.result_type)
+    {
+        int32_t i = atoi_(str).value.i;
+        memcpy(value, &i, sizeof(i));
+    }
+    else
+    {
+        float f = atof_(str).value.f;
+        memcpy(value, &f, sizeof(f));
     }
+    return number.result_type;
+}
 
-    input.f = value;
-    significand = input.bits.mantissa_lo;
-    significand += ((uint32_t) input.bits.mantissa_hi << 16);
-    //add the 24th bit to get 1.mmmm format
-    significand += 0x00800000;
-    exponent = input.bits.exponent - 127;
-    int_part = 0;
+static const char digit_pairs_[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
 
-    // TODO: include exponent notation (E, e) in the string.
-    if (exponent >= 31)
+/*
+ * Write an unsigned decimal, two digits at a time from the end.
+ */
+static int utoa_(uint32_t input, char *str)
+{
+    char buf[10];
+    char *p = buf + sizeof(buf);
+    while (input >= 100)
     {
-        strcpy(str, "Inf");
-        return 3;
+        uint32_t pair = input % 100;
+        input /= 100;
+        p -= 2;
+        memcpy(p, &digit_pairs_[pair * 2], 2);
     }
-    else if (exponent < -23)
+    if (input >= 10)
     {
-        strcpy(str, "0");
-        return 1;
+        p -= 2;
+        memcpy(p, &digit_pairs_[input * 2], 2);
     }
-    else if (exponent >= 23)
-    {    // significand bits are 23+1 bits so it need to be moved to show integer parts well. And it won't have faction part.
-        int_part = significand << (exponent - 23);
-        frac_part = 0;
+    else
+    {
+        *--p = '0' + input;
     }
-    else if (exponent >= 0)
+    int n = buf + sizeof(buf) - p;
+    memcpy(str, p, n);
+    str[n] = '\0';
+    return n;
+}
+
+static int itoa_(int input, char *str)
+{
+    if (input < 0)
     {
-        int_part = significand >> (23 - exponent);
-        frac_part = (significand << (exponent + 1)) & 0xFFFFFF;
+        *str = '-';
+        return utoa_(0u - (uint32_t)input, str + 1) + 1;
     }
-    else /* if (exponent < 0) */
+    return utoa_(input, str);
+}
+
+/*
+ * Shortest round-trip float formatting, using the Ryu algorithm by Ulf Adams
+ * ("Ryu: fast float-to-string conversion", PLDI 2018) for 32-bit floats.
+ */
+#define FLOAT_MANTISSA_BITS     23
+#define FLOAT_EXPONENT_BITS     8
+#define FLOAT_BIAS              127
+#define FLOAT_POW5_INV_BITCOUNT 59
+#define FLOAT_POW5_BITCOUNT     61
+
+// floor(2^(pow5bits_(i) - 1 + FLOAT_POW5_INV_BITCOUNT) / 5^i) + 1
+static const uint64_t float_pow5_inv_split_[31] = {
+    0x0800000000000001u, 0x0666666666666667u, 0x051eb851eb851eb9u,
+    0x04189374bc6a7efau, 0x068db8bac710cb2au, 0x053e2d6238da3c22u,
+    0x0431bde82d7b634eu, 0x06b5fca6af2bd216u, 0x055e63b88c230e78u,
+    0x044b82fa09b5a52du, 0x06df37f675ef6eaeu, 0x057f5ff85e592558u,
+    0x0465e6604b7a8447u, 0x0709709a125da071u, 0x05a126e1a84ae6c1u,
+    0x0480ebe7b9d58567u, 0x0734aca5f6226f0bu, 0x05c3bd5191b525a3u,
+    0x049c97747490eae9u, 0x0760f253edb4ab0eu, 0x05e72843249088d8u,
+    0x04b8ed0283a6d3e0u, 0x078e480405d7b966u, 0x060b6cd004ac9452u,
+    0x04d5f0a66a23a9dbu, 0x07bcb43d769f762bu, 0x063090312bb2c4efu,
+    0x04f3a68dbc8f03f3u, 0x07ec3daf94180651u, 0x065697bfa9acd1dau,
+    0x051212ffbaf0a7e2u,
+};
+
+// 5^i, normalized to FLOAT_POW5_BITCOUNT bits
+static const uint64_t float_pow5_split_[48] = {
+    0x1000000000000000u, 0x1400000000000000u, 0x1900000000000000u,
+    0x1f40000000000000u, 0x1388000000000000u, 0x186a000000000000u,
+    0x1e84800000000000u, 0x1312d00000000000u, 0x17d7840000000000u,
+    0x1dcd650000000000u, 0x12a05f2000000000u, 0x174876e800000000u,
+    0x1d1a94a200000000u, 0x12309ce540000000u, 0x16bcc41e90000000u,
+    0x1c6bf52634000000u, 0x11c37937e0800000u, 0x16345785d8a00000u,
+    0x1bc16d674ec80000u, 0x1158e460913d0000u, 0x15af1d78b58c4000u,
+    0x1b1ae4d6e2ef5000u, 0x10f0cf064dd59200u, 0x152d02c7e14af680u,
+    0x1a784379d99db420u, 0x108b2a2c28029094u, 0x14adf4b7320334b9u,
+    0x19d971e4fe8401e7u, 0x1027e72f1f128130u, 0x1431e0fae6d7217cu,
+    0x193e5939a08ce9dbu, 0x1f8def8808b02452u, 0x13b8b5b5056e16b3u,
+    0x18a6e32246c99c60u, 0x1ed09bead87c0378u, 0x13426172c74d822bu,
+    0x1812f9cf7920e2b6u, 0x1e17b84357691b64u, 0x12ced32a16a1b11eu,
+    0x178287f49c4a1d66u, 0x1d6329f1c35ca4bfu, 0x125dfa371a19e6f7u,
+    0x16f578c4e0a060b5u, 0x1cb2d6f618c878e3u, 0x11efc659cf7d4b8du,
+    0x166bb7f0435c9e71u, 0x1c06a5ec5433c60du, 0x118427b3b4a05bc8u,
+};
+
+// bit length of 5^e
+static inline int32_t pow5bits_(int32_t e)
+{
+    return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e))
+static inline int32_t log10_pow2_(int32_t e)
+{
+    return (int32_t)(((uint32_t)e * 78913) >> 18);
+}
+
+// floor(log10(5^e))
+static inline int32_t log10_pow5_(int32_t e)
+{
+    return (int32_t)(((uint32_t)e * 732923) >> 20);
+}
+
+static inline int multiple_of_pow5_(uint32_t value, int32_t p)
+{
+    int32_t count = 0;
+    while (value % 5 == 0)
     {
-        frac_part = (significand & 0xFFFFFF) >> (-(exponent + 1));
+        value /= 5;
+        count++;
     }
+    return count >= p;
+}
+
+static inline int multiple_of_pow2_(uint32_t value, int32_t p)
+{
+    return (value & ((1u << p) - 1)) == 0;
+}
 
-    p = str;
+static inline uint32_t mul_shift_(uint32_t m, uint64_t factor, int32_t shift)
+{
+    uint64_t bits0 = (uint64_t)m * (uint32_t)factor;
+    uint64_t bits1 = (uint64_t)m * (uint32_t)(factor >> 32);
+    uint64_t sum = (bits0 >> 32) + bits1;
+    return (uint32_t)(sum >> (shift - 32));
+}
 
-    if (input.bits.sign)
+/*
+ * Find the shortest digits that read back as the same float.
+ * The value is *digits x 10^(return value).
+ */
+static int32_t float_to_decimal_(uint32_t mantissa, uint32_t exponent, uint32_t *digits)
+{
+    int32_t e2;
+    uint32_t m2;
+    if (0 == exponent)
     {
-        *p++ = '-';
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = mantissa;
+    }
+    else
+    {
+        e2 = (int32_t)exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = (1u << FLOAT_MANTISSA_BITS) | mantissa;
     }
-    if (int_part == 0)
+    const int accept_bounds = (m2 & 1) == 0;
+
+    // the interval of values that round to this float, times 4
+    const uint32_t mv = 4 * m2;
+    const uint32_t mm_shift = (0 != mantissa || exponent <= 1);
+    uint32_t vr, vp, vm;
+    int32_t e10;
+    int vm_trailing_zeros = 0;
+    int vr_trailing_zeros = 0;
+    uint8_t last_removed = 0;
+    if (e2 >= 0)
     {
-        *p++ = '0';
+        const int32_t q = log10_pow2_(e2);
+        e10 = q;
+        const int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5bits_(q) - 1;
+        const int32_t i = -e2 + q + k;
+        vr = mul_shift_(mv, float_pow5_inv_split_[q], i);
+        vp = mul_shift_(mv + 2, float_pow5_inv_split_[q], i);
+        vm = mul_shift_(mv - 1 - mm_shift, float_pow5_inv_split_[q], i);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10)
+        {
+            const int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5bits_(q - 1) - 1;
+            last_removed = mul_shift_(mv, float_pow5_inv_split_[q - 1], -e2 + q - 1 + l) % 10;
+        }
+        if (q <= 9)
+        {
+            if (mv % 5 == 0)
+            {
+                vr_trailing_zeros = multiple_of_pow5_(mv, q);
+            }
+            else if (accept_bounds)
+            {
+                vm_trailing_zeros = multiple_of_pow5_(mv - 1 - mm_shift, q);
+            }
+            else
+            {
+                vp -= multiple_of_pow5_(mv + 2, q);
+            }
+        }
     }
     else
     {
-        itoa_(int_part, p, 10);
-        while (*p)
+        const int32_t q = log10_pow5_(-e2);
+        e10 = q + e2;
+        const int32_t i = -e2 - q;
+        const int32_t k = pow5bits_(i) - FLOAT_POW5_BITCOUNT;
+        int32_t j = q - k;
+        vr = mul_shift_(mv, float_pow5_split_[i], j);
+        vp = mul_shift_(mv + 2, float_pow5_split_[i], j);
+        vm = mul_shift_(mv - 1 - mm_shift, float_pow5_split_[i], j);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10)
+        {
+            j = q - 1 - (pow5bits_(i + 1) - FLOAT_POW5_BITCOUNT);
+            last_removed = mul_shift_(mv, float_pow5_split_[i + 1], j) % 10;
+        }
+        if (q <= 1)
+        {
+            vr_trailing_zeros = 1;
+            if (accept_bounds)
+            {
+                vm_trailing_zeros = (mm_shift == 1);
+            }
+            else
+            {
+                --vp;
+            }
+        }
+        else if (q < 31)
         {
-            p++;
+            vr_trailing_zeros = multiple_of_pow2_(mv, q - 1);
         }
     }
-    *p++ = '.';
 
-    if (frac_part == 0)
+    // remove digits while the interval allows
+    int32_t removed = 0;
+    uint32_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros)
     {
-        *p++ = '0';
+        while (vp / 10 > vm / 10)
+        {
+            vm_trailing_zeros &= (vm % 10 == 0);
+            vr_trailing_zeros &= (last_removed == 0);
+            last_removed = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros)
+        {
+            while (vm % 10 == 0)
+            {
+                vr_trailing_zeros &= (last_removed == 0);
+                last_removed = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+        {   // round to even
+            last_removed = 4;
+        }
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
     }
     else
     {
-        uint8_t i;
-        // Here 5 is precision.
-        for (i = 0; i < 5; i++)
+        while (vp / 10 > vm / 10)
         {
-            /* frac_part *= 10;    */
-            frac_part = (frac_part << 3) + (frac_part << 1);
+            last_removed = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || last_removed >= 5);
+    }
+    *digits = output;
+    return e10 + removed;
+}
+
+/*
+ * Write a float with the fewest digits that read back the same. Plain
+ * notation is used for 1e-4 <= |value| < 1e9 and always has a '.', so the
+ * parser reads it back as a float. Exponent notation is used otherwise.
+ * At most 15 characters are written. NaN and infinity are written as null.
+ */
+static int ftoa_(float value, char *str)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = bits >> 31;
+    const uint32_t mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+    const uint32_t exponent = (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1);
+    char *p = str;
 
-            *p++ = (frac_part >> 24) + '0';
-            frac_part &= 0xFFFFFF;
+    if (exponent == ((1u << FLOAT_EXPONENT_BITS) - 1))
+    {   // not representable in JSON
+        strcpy(str, "null");
+        return 4;
+    }
+    if (sign)
+    {
+        *p++ = '-';
+    }
+    if (0 == exponent && 0 == mantissa)
+    {
+        strcpy(p, "0.0");
+        return p + 3 - str;
+    }
+
+    uint32_t digits;
+    int32_t e10 = float_to_decimal_(mantissa, exponent, &digits);
+    char digit_str[11];
+    int32_t len = utoa_(digits, digit_str);
+    int32_t point = len + e10;    // position of '.' in the digits
+
+    if (point > -4 && point <= 9)
+    {
+        if (point <= 0)
+        {   // 0.000ddd
+            memcpy(p, "0.", 2);
+            p += 2;
+            memset(p, '0', -point);
+            p += -point;
+            memcpy(p, digit_str, len);
+            p += len;
+        }
+        else if (point >= len)
+        {   // ddd000.0
+            memcpy(p, digit_str, len);
+            p += len;
+            memset(p, '0', point - len);
+            p += point - len;
+            memcpy(p, ".0", 2);
+            p += 2;
+        }
+        else
+        {   // ddd.ddd
+            memcpy(p, digit_str, point);
+            p += point;
+            *p++ = '.';
+            memcpy(p, digit_str + point, len - point);
+            p += len - point;
         }
-        /* delete ending zeroes */
-        for (--p; p[0] == '0' && p[-1] != '.'; --p)
+    }
+    else
+    {   // d.ddde-dd
+        *p++ = digit_str[0];
+        if (len > 1)
         {
+            *p++ = '.';
+            memcpy(p, digit_str + 1, len - 1);
+            p += len - 1;
         }
-        ++p;
+        *p++ = 'e';
+        p += itoa_(point - 1, p);
     }
     *p = '\0';
-
-    return strlen(str);
+    return p - str;
 }
-
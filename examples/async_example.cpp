@@ -0,0 +1,181 @@
+/*
+ * Objects from many slow connections in one thread. Each connection is a
+ * socketpair written a few bytes at a time, and read by a coroutine of
+ * json::parse_stream() that an epoll loop resumes. Needs C++20.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "emjson_async.hpp"
+
+#define MAX_CONNECTIONS 2000
+#define MESSAGES        20
+#define PIECE           7		// bytes written to a connection at a time
+
+// One read buffer for all connections, as a piece is parsed before the next read.
+static char read_buf_[4096];
+
+// Bytes of a nonblocking socket. A read that would block waits for the loop.
+class socket_source
+{
+public:
+    explicit socket_source(int fd) noexcept : fd_(fd) {}
+
+    struct awaiter
+    {
+        socket_source &source;
+        ssize_t len;
+
+        bool await_ready() noexcept
+        {
+            len = ::read(source.fd_, read_buf_, sizeof(read_buf_));
+            return !(len < 0 && EAGAIN == errno);
+        }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { source.waiting_ = handle; }
+        std::string_view await_resume() noexcept
+        {
+            if (source.waiting_)
+            {   // resumed by the loop, so there is something to read
+                source.waiting_ = nullptr;
+                len = ::read(source.fd_, read_buf_, sizeof(read_buf_));
+            }
+            return (len > 0) ? std::string_view(read_buf_, len) : std::string_view();
+        }
+    };
+
+    awaiter read() noexcept { return awaiter{*this, 0}; }
+    void resume() { waiting_.resume(); }
+
+private:
+    int fd_;
+    std::coroutine_handle<> waiting_;
+};
+
+struct connection
+{
+    int read_fd;
+    int write_fd;
+    std::string text;		// what the client sends
+    std::size_t sent;
+    socket_source source;
+    json::task task;
+    int objects;
+    int errors;
+};
+
+static double now_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// As many connections as file descriptors allow, up to MAX_CONNECTIONS.
+static int connection_count_()
+{
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    rlim_t count = (limit.rlim_cur - 16) / 2;
+    return (count < MAX_CONNECTIONS) ? static_cast<int>(count) : MAX_CONNECTIONS;
+}
+
+int main()
+{
+    const int count = connection_count_();
+    int epoll_fd = epoll_create1(0);
+    std::vector<connection> conns;
+    conns.reserve(count);	// the coroutines refer to their sources
+    for (int c = 0; c < count; c++)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+        {
+            std::perror("socketpair");
+            return 1;
+        }
+        std::string text;
+        char msg[160];
+        for (int m = 0; m < MESSAGES; m++)
+        {
+            std::snprintf(msg, sizeof(msg), "{\"conn\": %d, \"seq\": %d, \"temp\": %d.5, "
+                    "\"name\": \"sensor-%d\", \"pos\": {\"x\": %d, \"y\": %d}}\n",
+                    c, m, 20 + m % 5, c, m, -m);
+            text += msg;
+        }
+        conns.push_back(connection{fds[0], fds[1], text, 0, socket_source(fds[0]), {}, 0, 0});
+    }
+    for (int c = 0; c < count; c++)
+    {
+        connection &conn = conns[c];
+        conn.task = json::parse_stream(conn.source, [&conn, c](json::object obj) {
+            if (obj.get<int>("conn") != c || obj.get<int>("seq") != conn.objects ||
+                obj.get<json::view>("pos").get<int>("y") != -conn.objects)
+            {
+                conn.errors += 1;
+            }
+            conn.objects += 1;
+        });
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.read_fd, &event);
+    }
+
+    std::printf("%d connections, %d objects each, sent %d bytes at a time\n", count, MESSAGES, PIECE);
+    std::printf("kept between reads: a coroutine and a json::stream of %zu bytes\n",
+            sizeof(json::stream));
+    double start = now_();
+    int running = count;
+    std::vector<struct epoll_event> events(count);
+    while (running > 0)
+    {
+        // the clients send a piece each
+        for (connection &conn : conns)
+        {
+            if (conn.sent < conn.text.size())
+            {
+                std::size_t len = std::min<std::size_t>(PIECE, conn.text.size() - conn.sent);
+                ssize_t n = ::write(conn.write_fd, conn.text.data() + conn.sent, len);
+                conn.sent += (n > 0) ? n : 0;
+                if (conn.sent == conn.text.size())
+                {
+                    close(conn.write_fd);
+                }
+            }
+        }
+        int n = epoll_wait(epoll_fd, events.data(), count, 100);
+        for (int k = 0; k < n; k++)
+        {
+            connection &conn = *static_cast<connection *>(events[k].data.ptr);
+            conn.source.resume();
+            if (conn.task.done())
+            {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.read_fd, nullptr);
+                close(conn.read_fd);
+                running -= 1;
+            }
+        }
+    }
+    double elapsed = now_() - start;
+
+    long objects = 0;
+    int failed = 0;
+    for (connection &conn : conns)
+    {
+        objects += conn.objects;
+        failed += (JSON_OK != conn.task.status() || MESSAGES != conn.objects || conn.errors > 0);
+    }
+    close(epoll_fd);
+    std::printf("%ld objects in %.0f ms, %d connections failed\n", objects, elapsed * 1e3, failed);
+    return (0 == failed) ? 0 : 1;
+}
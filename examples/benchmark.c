@@ -0,0 +1,1137 @@
+/*
+ * emJSON benchmarks.
+ * Run `make bench` to build with optimization and run them.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "emJSON.h"
+
+static double now_(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A message with string fields of mixed length and some numbers.
+static json_t make_message_(int fields)
+{
+    static const char *values[] = {
+        "ok",
+        "2026-10-19T08:50:26.123456Z",
+        "gateway-eu-west-1.example.internal",
+        "The quick brown fox jumps over the lazy dog, again and again.",
+    };
+    json_t obj = emJSON_init();
+    char key[16];
+    for (int i = 0; i < fields; i++)
+    {
+        sprintf(key, "field_%d", i);
+        if (i % 4 == 3)
+        {
+            emJSON_insert_int(&obj, key, i * 7919);
+        }
+        else
+        {
+            emJSON_insert_str(&obj, key, (char *)values[i % 4]);
+        }
+    }
+    return obj;
+}
+
+/*******************************************************************************
+ * json_strcpy() + write() against json_to_iovec() + writev()
+ ******************************************************************************/
+
+static void drain_(int fd, size_t len)
+{
+    char buf[4096];
+    while (len > 0)
+    {
+        ssize_t n = read(fd, buf, (len < sizeof(buf)) ? len : sizeof(buf));
+        if (n <= 0)
+        {
+            return;
+        }
+        len -= n;
+    }
+}
+
+static void bench_send_(json_t *obj, const char *name)
+{
+    const int rounds = 20000;
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        return;
+    }
+    size_t len = json_strlen(obj);
+    char *str = malloc(len + 1);
+
+    printf("== Serialize and send %s (%u bytes) ==\n", name, (unsigned int)len);
+
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        int n = json_strcpy(str, obj);
+        if (write(fds[0], str, n) != n)
+        {
+            perror("write");
+        }
+        drain_(fds[1], n);
+    }
+    double copy_time = now_() - start;
+
+    json_iovec_t iov[256];
+    char side[1024];
+    json_writer_t writer;
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        int count;
+        json_writer_init(&writer, obj);
+        while ((count = json_to_iovec(&writer, iov, 256, side, sizeof(side))) > 0)
+        {
+            ssize_t n = writev(fds[0], iov, count);
+            drain_(fds[1], n);
+        }
+    }
+    double iovec_time = now_() - start;
+
+    printf("json_strcpy + write    : %8.0f msg/s\n", rounds / copy_time);
+    printf("json_to_iovec + writev : %8.0f msg/s\n", rounds / iovec_time);
+
+    free(str);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void bench_iovec(void)
+{
+    json_t obj = make_message_(64);
+    bench_send_(&obj, "64 short fields");
+    emJSON_free(&obj);
+
+    // a few big values, such as encoded blobs
+    char blob[2048];
+    memset(blob, 'x', sizeof(blob) - 1);
+    blob[sizeof(blob) - 1] = '\0';
+    obj = emJSON_init();
+    emJSON_insert_str(&obj, "id", "2026-10-19T08:50:26.123456Z");
+    emJSON_insert_str(&obj, "image", blob);
+    emJSON_insert_str(&obj, "thumbnail", blob + 1024);
+    emJSON_insert_str(&obj, "log", blob + 512);
+    bench_send_(&obj, "3 big fields");
+    emJSON_free(&obj);
+}
+
+/*******************************************************************************
+ * Number formatting
+ ******************************************************************************/
+
+static void bench_numbers(void)
+{
+    const int rounds = 20000;
+    const int fields = 128;
+    json_t obj = emJSON_init();
+    char key[16];
+    uint32_t seed = 12345;
+    for (int i = 0; i < fields; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        sprintf(key, "v%d", i);
+        if (i % 2)
+        {   // sensor-like readings
+            emJSON_insert_float(&obj, key, (float)(seed % 200000) / 1000.0f - 100.0f);
+        }
+        else
+        {
+            emJSON_insert_int(&obj, key, (int)(seed % 2000000) - 1000000);
+        }
+    }
+    size_t len = json_strlen(&obj);
+    char *str = malloc(len + 1);
+
+    printf("== Numeric payload: %d ints and floats (%u bytes) ==\n", fields, (unsigned int)len);
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_strcpy(str, &obj);
+    }
+    double time = now_() - start;
+    printf("json_strcpy : %8.2f M values/s\n", (double)rounds * fields / time / 1e6);
+
+    free(str);
+    emJSON_free(&obj);
+}
+
+/*******************************************************************************
+ * Cached serialization of periodic telemetry
+ ******************************************************************************/
+
+static void bench_cached(void)
+{
+    const int rounds = 200000;
+    const int fields = 64;
+    json_t obj = emJSON_init();
+    char key[16];
+    for (int i = 0; i < fields; i++)
+    {
+        sprintf(key, "sensor_%d", i);
+        emJSON_insert_float(&obj, key, i * 0.5f);
+    }
+    size_t size = json_strlen(&obj) + fields * 16;
+    char *str = malloc(size);
+    json_span_t *span = malloc(json_table_size(&obj) * sizeof(json_span_t));
+    json_cache_t cache;
+
+    printf("== %d floats, 2 changed each time ==\n", fields);
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_set_float(&obj, "sensor_3", i * 0.01f);
+        json_set_float(&obj, "sensor_40", -i * 0.01f);
+        json_strcpy(str, &obj);
+    }
+    printf("json_strcpy                : %8.0f msg/s\n", rounds / (now_() - start));
+
+    json_cache_init(&cache, str, size, span, json_table_size(&obj), 0);
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_set_float(&obj, "sensor_3", i * 0.01f);
+        json_set_float(&obj, "sensor_40", -i * 0.01f);
+        json_strcpy_cached(&cache, &obj);
+    }
+    printf("json_strcpy_cached         : %8.0f msg/s\n", rounds / (now_() - start));
+
+    json_cache_init(&cache, str, size, span, json_table_size(&obj), JSON_CACHE_FIXED_WIDTH);
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_set_float(&obj, "sensor_3", i * 0.01f);
+        json_set_float(&obj, "sensor_40", -i * 0.01f);
+        json_strcpy_cached(&cache, &obj);
+    }
+    printf("json_strcpy_cached (fixed) : %8.0f msg/s\n", rounds / (now_() - start));
+
+    free(span);
+    free(str);
+    emJSON_free(&obj);
+}
+
+/*******************************************************************************
+ * CBOR against JSON text
+ ******************************************************************************/
+
+static void bench_codec_(json_t *obj, const char *name)
+{
+    const int rounds = 20000;
+    size_t size = json_buffer_size(obj) * 2;
+    size_t table_size = json_table_size(obj);
+    char *text = malloc(json_strlen(obj) + 1);
+    int text_len = json_strcpy(text, obj);
+    uint8_t *cbor = malloc(size);
+    int cbor_len = json_to_cbor(cbor, obj, size);
+    void *buf = malloc(size);
+    json_t tmp;
+
+    printf("== %s: JSON %d bytes, CBOR %d bytes ==\n", name, text_len, cbor_len);
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_strcpy(text, obj);
+    }
+    printf("json_strcpy    : %8.0f msg/s\n", rounds / (now_() - start));
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_to_cbor(cbor, obj, size);
+    }
+    printf("json_to_cbor   : %8.0f msg/s\n", rounds / (now_() - start));
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        tmp = json_init(buf, size, table_size);
+        json_parse(&tmp, text);
+    }
+    printf("json_parse     : %8.0f msg/s\n", rounds / (now_() - start));
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        tmp = json_init(buf, size, table_size);
+        json_from_cbor(&tmp, cbor, cbor_len);
+    }
+    printf("json_from_cbor : %8.0f msg/s\n", rounds / (now_() - start));
+
+    free(buf);
+    free(cbor);
+    free(text);
+}
+
+static void bench_cbor(void)
+{
+    json_t obj = make_message_(64);
+    bench_codec_(&obj, "64 mixed fields");
+    emJSON_free(&obj);
+
+    obj = emJSON_init();
+    char key[16];
+    for (int i = 0; i < 64; i++)
+    {
+        sprintf(key, "t%d", i);
+        if (i % 2)
+        {
+            emJSON_insert_float(&obj, key, 20.0f + i * 0.37f);
+        }
+        else
+        {
+            emJSON_insert_int(&obj, key, i * 1000);
+        }
+    }
+    bench_codec_(&obj, "64 numbers");
+    emJSON_free(&obj);
+}
+
+/*******************************************************************************
+ * Loading a config: parse against a mapped snapshot
+ ******************************************************************************/
+
+static void bench_snapshot_(int fields)
+{
+    const int rounds = 2000;
+    char path[] = "/tmp/emjson_bench_XXXXXX";
+    json_t obj = make_message_(fields);
+    size_t size = json_buffer_size(&obj);
+    size_t table_size = json_table_size(&obj);
+    char *text = malloc(json_strlen(&obj) + 1);
+    json_strcpy(text, &obj);
+    void *buf = malloc(size);
+    int fd = mkstemp(path);
+    if (fd < 0 || JSON_OK != json_snapshot_write(&obj, fd))
+    {
+        perror("snapshot");
+        return;
+    }
+    close(fd);
+
+    printf("== Load a config of %d fields (%u bytes) ==\n", fields, (unsigned int)json_strlen(&obj));
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_t tmp = json_init(buf, size, table_size);
+        json_parse(&tmp, text);
+        json_get_str(&tmp, "field_1");
+    }
+    printf("json_parse        : %8.2f us\n", (now_() - start) / rounds * 1e6);
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_t tmp = json_snapshot_map(path);
+        json_get_str(&tmp, "field_1");
+        json_snapshot_unmap(&tmp);
+    }
+    printf("json_snapshot_map : %8.2f us\n", (now_() - start) / rounds * 1e6);
+
+    unlink(path);
+    free(buf);
+    free(text);
+    emJSON_free(&obj);
+}
+
+static void bench_snapshot(void)
+{
+    bench_snapshot_(64);
+    bench_snapshot_(1024);
+}
+
+/*******************************************************************************
+ * Pooled buffers in a gateway: init, parse, serialize, free
+ ******************************************************************************/
+
+static void bench_pooled(void)
+{
+    const int rounds = 20000;
+    json_t obj = make_message_(64);
+    char *text = emJSON_string(&obj);
+    char *input = malloc(strlen(text) + 1);
+    emJSON_free(&obj);
+
+    printf("== Gateway cycle, %u bytes ==\n", (unsigned int)strlen(text));
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        strcpy(input, text);
+        json_t msg = emJSON_init();
+        emJSON_parse(&msg, input);
+        char *out = emJSON_string(&msg);
+        free(out);
+        emJSON_free(&msg);
+    }
+    printf("emJSON_init / emJSON_free       : %8.0f msg/s\n", rounds / (now_() - start));
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        strcpy(input, text);
+        json_t msg = emJSON_init_pooled();
+        emJSON_parse(&msg, input);
+        char *out = emJSON_string(&msg);
+        free(out);
+        emJSON_release(&msg);
+    }
+    printf("emJSON_init_pooled / release    : %8.0f msg/s\n", rounds / (now_() - start));
+
+    emJSON_pooled_stats_t stats;
+    emJSON_pooled_stats(&stats);
+    printf("pool hits %u, misses %u\n", (unsigned int)stats.hits, (unsigned int)stats.misses);
+    emJSON_pooled_drain();
+    free(input);
+    free(text);
+}
+
+/*******************************************************************************
+ * Memory of cached objects: parsed as they are against emJSON_clone()
+ ******************************************************************************/
+
+static void bench_clone(void)
+{
+    enum { count = 1000 };
+    static json_t cache[count];
+    json_t obj = make_message_(24);
+    json_t nested = emJSON_insert_empty_obj(&obj, "meta");
+    emJSON_insert_str(&nested, "region", "eu-west-1");
+    emJSON_insert_int(&nested, "shard", 17);
+    char *text = emJSON_string(&obj);
+    char *input = malloc(strlen(text) + 1);
+    emJSON_free(&obj);
+
+    printf("== Caching %d objects of %u bytes ==\n", count, (unsigned int)strlen(text));
+    size_t parsed_bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        strcpy(input, text);
+        cache[i] = emJSON_init();
+        emJSON_parse(&cache[i], input);
+        parsed_bytes += json_buffer_size(&cache[i]);
+    }
+    size_t clone_bytes = 0;
+    double start = now_();
+    for (int i = 0; i < count; i++)
+    {
+        json_t clone = emJSON_clone(&cache[i]);
+        clone_bytes += json_buffer_size(&clone);
+        emJSON_free(&cache[i]);
+        cache[i] = clone;
+    }
+    double elapsed = now_() - start;
+    printf("parsed buffers                  : %8u bytes/object\n", (unsigned int)(parsed_bytes / count));
+    printf("emJSON_clone                    : %8u bytes/object, %.2f us each\n",
+            (unsigned int)(clone_bytes / count), elapsed * 1e6 / count);
+    for (int i = 0; i < count; i++)
+    {
+        emJSON_free(&cache[i]);
+    }
+    free(input);
+    free(text);
+}
+
+/*******************************************************************************
+ * json_parse() against json_parse_borrowed()
+ ******************************************************************************/
+
+static void bench_borrowed(void)
+{
+    const int rounds = 20000;
+    static uint8_t buf[16384];
+    json_t obj = make_message_(64);
+    char *text = emJSON_string(&obj);
+    size_t len = strlen(text);
+    char *input = malloc(len + 1);
+    emJSON_free(&obj);
+
+    printf("== Parsing %u bytes into a fixed buffer ==\n", (unsigned int)len);
+    json_memory_stats_t stats;
+    for (int borrow = 0; borrow < 2; borrow++)
+    {
+        double elapsed = 0;
+        for (int i = 0; i < rounds; i++)
+        {
+            memcpy(input, text, len + 1);
+            json_t msg = json_init(buf, sizeof(buf), 64);
+            double start = now_();
+            if (borrow)
+            {
+                json_parse_borrowed(&msg, input);
+            }
+            else
+            {
+                json_parse(&msg, input);
+            }
+            elapsed += now_() - start;
+            if (i == rounds - 1)
+            {
+                json_memory_stats(&msg, &stats);
+            }
+        }
+        printf("%-32s: %8.1f MB/s, content %u bytes\n",
+                borrow ? "json_parse_borrowed" : "json_parse",
+                len * rounds / elapsed / 1e6, (unsigned int)stats.content_bytes);
+    }
+    free(input);
+    free(text);
+}
+
+/*******************************************************************************
+ * Lookups in a shared frozen config from many threads, with reloads
+ ******************************************************************************/
+
+#define ATOMIC_KEYS     256
+
+static json_atomic_ref_t config_ref_;
+static char config_keys_[ATOMIC_KEYS][16];
+static int reloading_;
+
+struct lookup_arg_
+{
+    size_t reader;
+    size_t rounds;
+    size_t found;
+};
+
+static void *lookup_thread_(void *p)
+{
+    struct lookup_arg_ *arg = p;
+    size_t found = 0;
+    for (size_t i = 0; i < arg->rounds; i++)
+    {
+        json_t config = json_atomic_acquire(&config_ref_, arg->reader);
+        found += (NULL != json_get(&config, config_keys_[i % ATOMIC_KEYS], JSON_STRING));
+        json_atomic_release(&config_ref_, arg->reader);
+    }
+    arg->found = found;
+    return NULL;
+}
+
+static void *reload_thread_(void *p)
+{
+    (void)p;
+    while (__atomic_load_n(&reloading_, __ATOMIC_RELAXED))
+    {   // a new config every millisecond
+        json_t config = json_atomic_acquire(&config_ref_, JSON_ATOMIC_READERS - 1);
+        json_t fresh = emJSON_clone(&config);
+        json_atomic_release(&config_ref_, JSON_ATOMIC_READERS - 1);
+        emJSON_atomic_publish(&config_ref_, &fresh);
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+    return NULL;
+}
+
+static void bench_atomic(void)
+{
+    const size_t rounds = 1000000;
+    json_t config = make_message_(ATOMIC_KEYS);
+    for (int i = 0; i < ATOMIC_KEYS; i++)
+    {
+        sprintf(config_keys_[i], "field_%d", (i % 4 == 3) ? i - 1 : i);
+    }
+    json_atomic_init(&config_ref_, &config);
+
+    printf("== Lookups in a frozen config of %d keys, reloaded every ms ==\n", ATOMIC_KEYS);
+    for (size_t threads = 1; threads <= 32; threads *= 2)
+    {
+        pthread_t tid[32], reloader;
+        struct lookup_arg_ arg[32];
+        __atomic_store_n(&reloading_, 1, __ATOMIC_RELAXED);
+        pthread_create(&reloader, NULL, reload_thread_, NULL);
+        double start = now_();
+        for (size_t t = 0; t < threads; t++)
+        {
+            arg[t] = (struct lookup_arg_){ .reader = t, .rounds = rounds };
+            pthread_create(&tid[t], NULL, lookup_thread_, &arg[t]);
+        }
+        size_t found = 0;
+        for (size_t t = 0; t < threads; t++)
+        {
+            pthread_join(tid[t], NULL);
+            found += arg[t].found;
+        }
+        double elapsed = now_() - start;
+        __atomic_store_n(&reloading_, 0, __ATOMIC_RELAXED);
+        pthread_join(reloader, NULL);
+        printf("%2u readers                      : %8.1f M lookups/s%s\n", (unsigned int)threads,
+                threads * rounds / elapsed / 1e6, (found == threads * rounds) ? "" : " (missed keys!)");
+    }
+    json_t empty = {0};
+    json_t last = json_atomic_publish(&config_ref_, &empty);
+    emJSON_free(&last);
+}
+
+/*******************************************************************************
+ * Metrics counted by many threads while an exporter serializes them
+ ******************************************************************************/
+
+#define METRICS_KEYS    32
+
+static json_t metrics_;
+static char metrics_keys_[METRICS_KEYS][16];
+static pthread_mutex_t metrics_lock_ = PTHREAD_MUTEX_INITIALIZER;
+static int use_lock_;
+static int exporting_;
+
+static void *count_thread_(void *p)
+{
+    size_t rounds = *(size_t *)p;
+    for (size_t i = 0; i < rounds; i++)
+    {
+        char *key = metrics_keys_[i % METRICS_KEYS];
+        if (use_lock_)
+        {
+            pthread_mutex_lock(&metrics_lock_);
+            json_increment(&metrics_, key);
+            pthread_mutex_unlock(&metrics_lock_);
+        }
+        else
+        {
+            json_increment(&metrics_, key);
+        }
+    }
+    return NULL;
+}
+
+static void *export_thread_(void *p)
+{
+    size_t *exports = p;
+    char out[2048];
+    while (__atomic_load_n(&exporting_, __ATOMIC_RELAXED))
+    {
+        if (use_lock_)
+        {
+            pthread_mutex_lock(&metrics_lock_);
+            json_strncpy(out, &metrics_, sizeof(out));
+            pthread_mutex_unlock(&metrics_lock_);
+        }
+        else
+        {
+            json_strncpy(out, &metrics_, sizeof(out));
+        }
+        *exports += 1;
+    }
+    return NULL;
+}
+
+static void bench_metrics(void)
+{
+    const size_t rounds = 1000000;
+    printf("== %d counters, incremented by many threads and exported ==\n", METRICS_KEYS);
+    for (use_lock_ = 1; use_lock_ >= 0; use_lock_--)
+    {
+        for (size_t threads = 1; threads <= 8; threads *= 2)
+        {
+            metrics_ = emJSON_init();
+            for (int i = 0; i < METRICS_KEYS; i++)
+            {
+                sprintf(metrics_keys_[i], "requests_%d", i);
+                emJSON_insert_int(&metrics_, metrics_keys_[i], 1);
+            }
+            if (!use_lock_)
+            {
+                emJSON_make_concurrent(&metrics_);
+            }
+            pthread_t tid[8], exporter;
+            size_t exports = 0;
+            __atomic_store_n(&exporting_, 1, __ATOMIC_RELAXED);
+            pthread_create(&exporter, NULL, export_thread_, &exports);
+            double start = now_();
+            for (size_t t = 0; t < threads; t++)
+            {
+                pthread_create(&tid[t], NULL, count_thread_, (void *)&rounds);
+            }
+            for (size_t t = 0; t < threads; t++)
+            {
+                pthread_join(tid[t], NULL);
+            }
+            double elapsed = now_() - start;
+            __atomic_store_n(&exporting_, 0, __ATOMIC_RELAXED);
+            pthread_join(exporter, NULL);
+            size_t total = 0;
+            for (int i = 0; i < METRICS_KEYS; i++)
+            {
+                total += json_get_int(&metrics_, metrics_keys_[i]) - 1;
+            }
+            printf("%s, %u thr  : %8.1f M increments/s, %8.0f exports/s%s\n",
+                    use_lock_ ? "mutex     " : "concurrent", (unsigned int)threads,
+                    threads * rounds / elapsed / 1e6, exports / elapsed,
+                    (total == threads * rounds) ? "" : " (lost counts!)");
+            emJSON_free(&metrics_);
+        }
+    }
+}
+
+/*
+ * One big object of many members, as an inventory export, parsed by
+ * emJSON_parse() and by emJSON_parse_parallel() in 1 to 16 threads.
+ */
+static void bench_parallel(void)
+{
+    const int items = 150000;
+    const int rounds = 3;
+    char *text = malloc((size_t)items * 160 + 16);
+    size_t len = sprintf(text, "{");
+    for (int i = 0; i < items; i++)
+    {
+        len += sprintf(text + len, "%s\n  \"item%06d\": {\"sku\": \"SKU-%06d\", "
+                "\"name\": \"Widget %d, size {L}\", \"qty\": %d, \"price\": %d.%02d, "
+                "\"location\": {\"aisle\": %d, \"bin\": \"B-%d\"}}",
+                (i > 0) ? "," : "", i, i * 7, i, i % 500, i % 100, i % 97, i % 40, i % 13);
+    }
+    len += sprintf(text + len, "\n}\n");
+    char *input = malloc(len + 1);
+
+    printf("== Parsing one object of %d members, %.1f MB ==\n", items, len / 1e6);
+    double base = 0;
+    for (int threads = 0; threads <= 16; threads = (0 == threads) ? 1 : threads * 2)
+    {
+        double best = 1e9;
+        for (int i = 0; i < rounds; i++)
+        {
+            memcpy(input, text, len + 1);
+            json_t obj = emJSON_init();
+            double start = now_();
+            int ret = (0 == threads) ? emJSON_parse(&obj, input) :
+                    emJSON_parse_parallel(&obj, input, threads);
+            double elapsed = now_() - start;
+            if (JSON_OK != ret || (size_t)items != json_count(&obj))
+            {
+                printf("failed: %d\n", ret);
+            }
+            best = (elapsed < best) ? elapsed : best;
+            emJSON_free(&obj);
+        }
+        if (0 == threads)
+        {
+            printf("%-32s: %8.1f MB/s\n", "emJSON_parse", len / best / 1e6);
+            continue;
+        }
+        base = (1 == threads) ? best : base;
+        printf("emJSON_parse_parallel, %2d thr   : %8.1f MB/s, x%.2f\n",
+                threads, len / best / 1e6, base / best);
+    }
+    free(input);
+    free(text);
+}
+
+/*******************************************************************************
+ * A fixed message type through an object against struct binding
+ ******************************************************************************/
+
+typedef struct
+{
+    int device;
+    int seq;
+    float temperature;
+    float humidity;
+    int battery;
+    char status[8];
+    char site[24];
+    int rssi;
+} reading_t;
+
+#define READING_FIELDS(X) \
+    X(reading_t, device, JSON_INT) \
+    X(reading_t, seq, JSON_INT) \
+    X(reading_t, temperature, JSON_FLOAT) \
+    X(reading_t, humidity, JSON_FLOAT) \
+    X(reading_t, battery, JSON_INT) \
+    X(reading_t, status, JSON_STRING) \
+    X(reading_t, site, JSON_STRING) \
+    X(reading_t, rssi, JSON_INT)
+
+static const json_field_t reading_fields_[] = { READING_FIELDS(JSON_FIELD) };
+static const json_desc_t reading_desc_ = JSON_DESC(reading_fields_);
+
+static void bench_binding(void)
+{
+    const int rounds = 500000;
+    static uint8_t buf[2048];
+    char text[] = "{\"device\": 1042, \"seq\": 88123, \"temperature\": 21.5, "
+            "\"humidity\": 40.25, \"battery\": 87, \"status\": \"ok\", "
+            "\"site\": \"plant-7/line-3\", \"rssi\": -71}";
+    char input[sizeof(text)];
+    char out[256];
+    size_t len = strlen(text);
+    reading_t r = {0};
+    long sum = 0;
+
+    printf("== A message of %d fields into and out of a struct, %u bytes ==\n",
+            (int)reading_desc_.count, (unsigned int)len);
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        memcpy(input, text, sizeof(text));
+        json_t msg = json_init(buf, sizeof(buf), 16);
+        json_parse(&msg, input);
+        r.device = json_get_int(&msg, "device");
+        r.seq = json_get_int(&msg, "seq");
+        r.temperature = json_get_float(&msg, "temperature");
+        r.humidity = json_get_float(&msg, "humidity");
+        r.battery = json_get_int(&msg, "battery");
+        strncpy(r.status, json_get_str(&msg, "status"), sizeof(r.status) - 1);
+        strncpy(r.site, json_get_str(&msg, "site"), sizeof(r.site) - 1);
+        r.rssi = json_get_int(&msg, "rssi");
+        sum += r.seq;
+    }
+    double elapsed = now_() - start;
+    printf("%-32s: %8.1f MB/s  (%ld)\n", "json_parse + json_get_*", len * rounds / elapsed / 1e6, sum);
+
+    sum = 0;
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_parse_into(&r, &reading_desc_, text);
+        sum += r.seq;
+    }
+    elapsed = now_() - start;
+    printf("%-32s: %8.1f MB/s  (%ld)\n", "json_parse_into", len * rounds / elapsed / 1e6, sum);
+
+    json_t msg = json_init(buf, sizeof(buf), 16);
+    memcpy(input, text, sizeof(text));
+    json_parse(&msg, input);
+    sum = 0;
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_set_int(&msg, "device", r.device);
+        json_set_int(&msg, "seq", r.seq + i);
+        json_set_float(&msg, "temperature", r.temperature);
+        json_set_float(&msg, "humidity", r.humidity);
+        json_set_int(&msg, "battery", r.battery);
+        json_set_str(&msg, "status", r.status);
+        json_set_str(&msg, "site", r.site);
+        json_set_int(&msg, "rssi", r.rssi);
+        sum += json_strncpy(out, &msg, sizeof(out));
+    }
+    elapsed = now_() - start;
+    printf("%-32s: %8.1f MB/s  (%ld)\n", "json_set_* + json_strncpy", sum / elapsed / 1e6, sum);
+
+    sum = 0;
+    start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        json_out_t o = {
+            .buf = out,
+            .size = sizeof(out),
+            .len = 0,
+            .grow = NULL
+        };
+        r.seq += 1;
+        sum += json_write_from(&r, &reading_desc_, &o);
+    }
+    elapsed = now_() - start;
+    printf("%-32s: %8.1f MB/s  (%ld)\n", "json_write_from", sum / elapsed / 1e6, sum);
+}
+
+/*******************************************************************************
+ * emJSON_parse() of the whole text against emJSON_stream_feed() of pieces
+ ******************************************************************************/
+
+static void bench_stream(void)
+{
+    const int rounds = 20000;
+    static const size_t pieces[] = {16, 256, 1460};
+    json_t obj = make_message_(64);
+    char *text = emJSON_string(&obj);
+    size_t len = strlen(text);
+    char *input = malloc(len + 1);
+    emJSON_free(&obj);
+
+    printf("== Parsing %u bytes, whole and in pieces ==\n", (unsigned int)len);
+    double start = now_();
+    for (int i = 0; i < rounds; i++)
+    {
+        memcpy(input, text, len + 1);
+        json_t msg = emJSON_init();
+        emJSON_parse(&msg, input);
+        emJSON_free(&msg);
+    }
+    printf("%-32s: %8.1f MB/s\n", "emJSON_parse", len * rounds / (now_() - start) / 1e6);
+
+    emJSON_stream_t stream;
+    emJSON_stream_init(&stream);
+    for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++)
+    {
+        start = now_();
+        for (int i = 0; i < rounds; i++)
+        {
+            for (size_t pos = 0; pos < len; )
+            {
+                size_t used;
+                size_t piece = (len - pos < pieces[p]) ? len - pos : pieces[p];
+                if (1 == emJSON_stream_feed(&stream, text + pos, piece, &used))
+                {
+                    json_t msg = emJSON_stream_take(&stream);
+                    emJSON_free(&msg);
+                }
+                pos += used;
+            }
+        }
+        char name[40];
+        sprintf(name, "emJSON_stream_feed, %4u B", (unsigned int)pieces[p]);
+        printf("%-32s: %8.1f MB/s\n", name, len * rounds / (now_() - start) / 1e6);
+    }
+    emJSON_stream_end(&stream);
+    free(input);
+    free(text);
+}
+
+/*******************************************************************************
+ * Deep reads in a frozen config tree: json_get_obj() chains against paths
+ ******************************************************************************/
+
+// A level of 16 members, of which the first 4 are objects down to depth.
+static void fill_level_(json_t *obj, int depth)
+{
+    char key[16];
+    for (int i = 0; i < 16; i++)
+    {
+        sprintf(key, "node_%d", i);
+        if (i < 4 && depth > 1)
+        {
+            json_t child = emJSON_insert_empty_obj(obj, key);
+            fill_level_(&child, depth - 1);
+        }
+        else
+        {
+            emJSON_insert_int(obj, key, i * depth);
+        }
+    }
+}
+
+static void bench_path(void)
+{
+    const long rounds = 2000000;
+    json_t tree = emJSON_init();
+    fill_level_(&tree, 5);
+    json_t config = emJSON_clone(&tree);
+    json_freeze(&config);
+    emJSON_free(&tree);
+    const char *pointer = "/node_3/node_2/node_1/node_0/node_9";
+    json_path_t path;
+    json_path_compile(&path, pointer);
+    long sum;
+    double start;
+
+    printf("== A read 5 levels down a frozen tree of 16 members each ==\n");
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        json_t a = json_get_obj(&config, "node_3");
+        json_t b = json_get_obj(&a, "node_2");
+        json_t c = json_get_obj(&b, "node_1");
+        json_t d = json_get_obj(&c, "node_0");
+        sum += json_get_int(&d, "node_9");
+    }
+    printf("%-32s: %6.1f ns/op  (%ld)\n", "json_get_obj x4 + json_get_int",
+            (now_() - start) / rounds * 1e9, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        sum += *(int *)json_get_path(&config, pointer, JSON_INT);
+    }
+    printf("%-32s: %6.1f ns/op  (%ld)\n", "json_get_path", (now_() - start) / rounds * 1e9, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        sum += *(int *)json_path_get(&path, &config, JSON_INT);
+    }
+    printf("%-32s: %6.1f ns/op  (%ld)\n", "json_path_get, compiled", (now_() - start) / rounds * 1e9, sum);
+
+    json_path_resolve(&path, &config);
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        sum += *(int *)json_path_get(&path, &config, JSON_INT);
+    }
+    printf("%-32s: %6.1f ns/op  (%ld)\n", "json_path_get, resolved", (now_() - start) / rounds * 1e9, sum);
+    emJSON_free(&config);
+}
+
+/*******************************************************************************
+ * Batched lookups in an object far bigger than the caches
+ ******************************************************************************/
+
+#define MANY_KEYS   (1 << 18)
+#define MANY_BATCH  16
+
+static void bench_get_many(void)
+{
+    const long rounds = 200000;
+    static char names[MANY_KEYS][16];
+    static char *keys[MANY_KEYS];
+    json_member_t out[MANY_BATCH];
+    // sized at once, as an emJSON object grows a few bytes at a time: a table
+    // of 2 slots of 40 bytes for a key, and 32 bytes for the key and value
+    size_t size = 2 * MANY_KEYS * 40 + MANY_KEYS * 32 + 4096;
+    void *buf = malloc(size);
+    json_t obj = json_init(buf, size, 2 * MANY_KEYS);
+    for (int i = 0; i < MANY_KEYS; i++)
+    {
+        sprintf(names[i], "key_%d", i);
+        json_insert_int(&obj, names[i], i);
+    }
+    // keys in a random order, so that the lookups of a batch miss the caches
+    uint32_t seed = 12345;
+    for (int i = 0; i < MANY_KEYS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        keys[i] = names[(seed >> 8) % MANY_KEYS];
+    }
+    json_memory_stats_t stats;
+    json_memory_stats(&obj, &stats);
+    long sum;
+    double start;
+
+    printf("== %d random keys at a time of %d int members, %zu KB of table ==\n",
+            MANY_BATCH, MANY_KEYS, stats.table_bytes / 1024);
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        char **batch = keys + (r * MANY_BATCH) % MANY_KEYS;
+        for (int k = 0; k < MANY_BATCH; k++)
+        {
+            sum += json_get_int(&obj, batch[k]);
+        }
+    }
+    printf("%-32s: %6.1f ns/key (%ld)\n", "json_get_int x16",
+            (now_() - start) / (rounds * MANY_BATCH) * 1e9, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        char **batch = keys + (r * MANY_BATCH) % MANY_KEYS;
+        json_get_many(&obj, batch, MANY_BATCH, out);
+        for (int k = 0; k < MANY_BATCH; k++)
+        {
+            sum += *(int *)out[k].value;
+        }
+    }
+    printf("%-32s: %6.1f ns/key (%ld)\n", "json_get_many",
+            (now_() - start) / (rounds * MANY_BATCH) * 1e9, sum);
+    free(buf);
+}
+
+/*******************************************************************************
+ * Building a message member by member, and in one batch
+ ******************************************************************************/
+
+#define BATCH_MEMBERS   32
+
+static void bench_batch(void)
+{
+    const long rounds = 200000;
+    static char keys[BATCH_MEMBERS][16];
+    static char strs[BATCH_MEMBERS][24];
+    int32_t ints[BATCH_MEMBERS];
+    float floats[BATCH_MEMBERS];
+    json_member_t items[BATCH_MEMBERS];
+    for (int i = 0; i < BATCH_MEMBERS; i++)
+    {
+        sprintf(keys[i], "field_%d", i);
+        sprintf(strs[i], "value of field %d", i);
+        ints[i] = i * 1000;
+        floats[i] = i + 0.5f;
+        items[i].key = keys[i];
+        items[i].type = (i % 3 == 0) ? JSON_STRING : (i % 3 == 1) ? JSON_INT : JSON_FLOAT;
+        items[i].value = (i % 3 == 0) ? (void *)strs[i] : (i % 3 == 1) ? (void *)&ints[i] :
+                (void *)&floats[i];
+    }
+    uint8_t buf[4096];
+    long sum;
+    double start;
+
+    printf("== A message of %d members ==\n", BATCH_MEMBERS);
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        json_t obj = emJSON_init();
+        for (int i = 0; i < BATCH_MEMBERS; i++)
+        {
+            emJSON_insert(&obj, items[i].key, items[i].value, items[i].type);
+        }
+        sum += json_strlen(&obj);
+        emJSON_free(&obj);
+    }
+    printf("%-32s: %6.0f ns/msg (%ld)\n", "emJSON_insert x32", (now_() - start) / rounds * 1e9, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        json_t obj = emJSON_init();
+        emJSON_insert_batch(&obj, items, BATCH_MEMBERS);
+        sum += json_strlen(&obj);
+        emJSON_free(&obj);
+    }
+    printf("%-32s: %6.0f ns/msg (%ld)\n", "emJSON_insert_batch", (now_() - start) / rounds * 1e9, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        json_t obj = json_init(buf, sizeof(buf), 64);
+        for (int i = 0; i < BATCH_MEMBERS; i++)
+        {
+            json_insert(&obj, items[i].key, items[i].value, items[i].type);
+        }
+        sum += json_strlen(&obj);
+    }
+    printf("%-32s: %6.0f ns/msg (%ld)\n", "json_insert x32, fixed", (now_() - start) / rounds * 1e9, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        json_t obj = json_init(buf, sizeof(buf), 64);
+        json_insert_batch(&obj, items, BATCH_MEMBERS);
+        sum += json_strlen(&obj);
+    }
+    printf("%-32s: %6.0f ns/msg (%ld)\n", "json_insert_batch, fixed", (now_() - start) / rounds * 1e9, sum);
+}
+
+int main(void)
+{
+    bench_iovec();
+    bench_numbers();
+    bench_cached();
+    bench_cbor();
+    bench_snapshot();
+    bench_pooled();
+    bench_clone();
+    bench_borrowed();
+    bench_atomic();
+    bench_metrics();
+    bench_parallel();
+    bench_binding();
+    bench_stream();
+    bench_path();
+    bench_get_many();
+    bench_batch();
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Benchmarks of the C++ interface against the C API it calls.
+ * Run `make bench` to build with optimization and run them.
+ */
+#include <cstdio>
+#include <ctime>
+#include <string_view>
+#include "emjson.hpp"
+
+using namespace json::literals;
+
+static_assert(sizeof(json::object) == sizeof(json_t), "json::object is a json_t");
+static_assert(sizeof(json::view) == sizeof(json_t), "json::view is a json_t");
+static_assert(sizeof(json::fixed_view) == sizeof(json_t), "json::fixed_view is a json_t");
+// hashed by the compiler
+static_assert("sensor_1"_k.hash == json::hash("sensor_1"), "json::hash is constexpr");
+
+static double now_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define KEYS    64
+
+static char keys_[KEYS][16];
+static std::string_view key_views_[KEYS];
+
+static void print_(const char *name, double elapsed, long ops, long sum)
+{
+    // the sum is printed so that the loops are not optimized out
+    std::printf("%-32s: %6.2f ns/op  (%ld)\n", name, elapsed / ops * 1e9, sum);
+}
+
+/*******************************************************************************
+ * Lookups, changes and iteration, by C and by C++
+ ******************************************************************************/
+
+static void bench_access()
+{
+    const long rounds = 200000;
+    json::object obj;
+    for (int i = 0; i < KEYS; i++)
+    {
+        std::sprintf(keys_[i], "sensor_%d", i);
+        key_views_[i] = keys_[i];
+        obj.insert(keys_[i], i);
+    }
+    json_t *c_obj = obj.c_obj();
+    long sum;
+    double start;
+
+    std::printf("== %d int members, C API against emjson.hpp ==\n", KEYS);
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < KEYS; i++)
+        {
+            sum += json_get_int(c_obj, keys_[i]);
+        }
+    }
+    print_("json_get_int", now_() - start, rounds * KEYS, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < KEYS; i++)
+        {
+            sum += obj.get<int>(static_cast<const char *>(keys_[i]));
+        }
+    }
+    print_("get<int>(const char *)", now_() - start, rounds * KEYS, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < KEYS; i++)
+        {
+            sum += obj.get<int>(key_views_[i]);
+        }
+    }
+    print_("get<int>(string_view)", now_() - start, rounds * KEYS, sum);
+
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < KEYS; i++)
+        {
+            json_set_int(c_obj, keys_[i], (int)r + i);
+        }
+    }
+    print_("json_set_int", now_() - start, rounds * KEYS, json_get_int(c_obj, keys_[1]));
+
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < KEYS; i++)
+        {
+            obj.set(key_views_[i], (int)r + i);
+        }
+    }
+    print_("set<int>(string_view)", now_() - start, rounds * KEYS, obj.get<int>("sensor_1"));
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        size_t idx = 0;
+        json_member_t member;
+        while (json_next(c_obj, &idx, &member))
+        {
+            sum += *(int *)member.value;
+        }
+    }
+    print_("json_next", now_() - start, rounds * KEYS, sum);
+
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        for (json::member member : obj)
+        {
+            sum += member.get<int>();
+        }
+    }
+    print_("range-for", now_() - start, rounds * KEYS, sum);
+}
+
+/*******************************************************************************
+ * Keys hashed at compile time, and objects of a fixed buffer
+ ******************************************************************************/
+
+// Read and update a few known keys, as a hot loop would.
+template <typename Obj>
+static long update_known_(Obj &obj, long rounds)
+{
+    long sum = 0;
+    for (long r = 0; r < rounds; r++)
+    {
+        sum += obj["temperature"_k].template get<int>();
+        sum += obj["humidity"_k].template get<int>();
+        obj["pressure"_k].set(static_cast<int>(r));
+    }
+    return sum;
+}
+
+static void bench_known_keys()
+{
+    const long rounds = 2000000;
+    char temperature[] = "temperature";
+    char humidity[] = "humidity";
+    char pressure[] = "pressure";
+    json::object obj;
+    json::static_object<1024, 16> static_obj;
+    for (int i = 0; i < 8; i++)
+    {
+        char key[16];
+        std::sprintf(key, "sensor_%d", i);
+        obj.insert(key, i);
+        static_obj.insert(key, i);
+    }
+    obj.insert("temperature", 21);
+    obj.insert("humidity", 40);
+    obj.insert("pressure", 1000);
+    static_obj.insert("temperature", 21);
+    static_obj.insert("humidity", 40);
+    static_obj.insert("pressure", 1000);
+    json_t *c_obj = obj.c_obj();
+    long sum;
+    double start;
+
+    std::printf("== 3 known keys per round, hashed at run time against \"name\"_k ==\n");
+    sum = 0;
+    start = now_();
+    for (long r = 0; r < rounds; r++)
+    {
+        sum += json_get_int(c_obj, temperature);
+        sum += json_get_int(c_obj, humidity);
+        json_set_int(c_obj, pressure, (int)r);
+    }
+    print_("json_get_int/json_set_int", now_() - start, rounds * 3, sum);
+
+    start = now_();
+    sum = update_known_(obj, rounds);
+    print_("object[\"name\"_k]", now_() - start, rounds * 3, sum);
+
+    start = now_();
+    sum = update_known_(static_obj, rounds);
+    print_("static_object[\"name\"_k]", now_() - start, rounds * 3, sum);
+}
+
+int main()
+{
+    bench_access();
+    bench_known_keys();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "json.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Struct binding: an object is parsed straight into a struct and written
+ * back from it, with no json_t in between. Numbers out of the range of
+ * their fields are refused. Run by "make test".
+ */
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+typedef struct
+{
+	int16_t x;
+	int16_t y;
+} pos_t;
+
+typedef struct
+{
+	int32_t id;
+	int8_t level;
+	float temp;
+	char name[16];
+	pos_t pos;
+} sensor_t;
+
+#define POS_FIELDS(X) \
+	X(pos_t, x, JSON_INT) \
+	X(pos_t, y, JSON_INT)
+
+static const json_field_t pos_fields[] = { POS_FIELDS(JSON_FIELD) };
+static const json_desc_t pos_desc = JSON_DESC(pos_fields);
+
+static const json_field_t sensor_fields[] = {
+	JSON_FIELD(sensor_t, id, JSON_INT)
+	JSON_FIELD(sensor_t, level, JSON_INT)
+	JSON_FIELD(sensor_t, temp, JSON_FLOAT)
+	JSON_FIELD(sensor_t, name, JSON_STRING)
+	JSON_FIELD_OBJ(sensor_t, pos, pos_desc)
+};
+static const json_desc_t sensor_desc = JSON_DESC(sensor_fields);
+
+int main(void)
+{
+	const char *input = "{\"id\": -2147483648, \"level\": 127, \"temp\": 21.5, "
+			"\"name\": \"sensor\", \"unknown\": \"skipped\", \"pos\": {\"x\": -32768, \"y\": 32767}}";
+	sensor_t sensor = {0};
+	CHECK((int)strlen(input) == json_parse_into(&sensor, &sensor_desc, input));
+	CHECK(INT32_MIN == sensor.id);
+	CHECK(127 == sensor.level);
+	CHECK(21.5f == sensor.temp);
+	CHECK(0 == strcmp("sensor", sensor.name));
+	CHECK(-32768 == sensor.pos.x);
+	CHECK(32767 == sensor.pos.y);
+
+	// written back, and read again as it was
+	char text[256];
+	json_out_t out = { text, sizeof(text), 0, NULL };
+	int len = json_write_from(&sensor, &sensor_desc, &out);
+	CHECK(len > 0 && len < (int)sizeof(text));
+	text[len] = '\0';
+	sensor_t again = {0};
+	CHECK(len == json_parse_into(&again, &sensor_desc, text));
+	CHECK(0 == memcmp(&sensor, &again, sizeof(sensor)));
+
+	// out of the range of the field, or of int32_t
+	CHECK(json_parse_into(&again, &sensor_desc, "{\"level\": 128}") < 0);
+	CHECK(json_parse_into(&again, &sensor_desc, "{\"level\": -129}") < 0);
+	CHECK(json_parse_into(&again, &sensor_desc, "{\"pos\": {\"x\": 40000}}") < 0);
+	CHECK(json_parse_into(&again, &sensor_desc, "{\"id\": 2147483648}") < 0);
+	CHECK(json_parse_into(&again, &sensor_desc, "{\"id\": 99999999999999999999}") < 0);
+	// not an integer
+	CHECK(JSON_TYPE_MISMATCH == json_parse_into(&again, &sensor_desc, "{\"id\": 1.5}"));
+	CHECK(JSON_TYPE_MISMATCH == json_parse_into(&again, &sensor_desc, "{\"id\": \"1\"}"));
+
+	printf("binding_example: %d failures\n", failures);
+	return failures ? 1 : 0;
+}
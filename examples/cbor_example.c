@@ -0,0 +1,80 @@
+#include "json.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * CBOR: an object is encoded to binary and decoded back. Input with text
+ * too long, or maps nested too deep, is refused. Run by "make test".
+ */
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+int main(void)
+{
+	char input[] = "{\"id\":-7,\"name\":\"sensor\",\"pos\":{\"x\":1,\"y\":70000},\"temp\":21.5}";
+	static char buffer[1024];
+	json_t obj = json_init(buffer, sizeof(buffer), 8);
+	CHECK(json_parse(&obj, input) > 0);
+
+	// round trip
+	uint8_t cbor[256];
+	int len = json_to_cbor(cbor, &obj, sizeof(cbor));
+	CHECK(len > 0 && len <= (int)sizeof(cbor));
+	static char buffer2[1024];
+	json_t decoded = json_init(buffer2, sizeof(buffer2), 8);
+	CHECK(len == json_from_cbor(&decoded, cbor, len));
+	json_t pos = json_get_obj(&decoded, "pos");
+	CHECK(-7 == json_get_int(&decoded, "id"));
+	CHECK(0 == strcmp("sensor", json_get_str(&decoded, "name")));
+	CHECK(21.5f == json_get_float(&decoded, "temp"));
+	CHECK(70000 == json_get_int(&pos, "y"));
+
+	// {"s": "xx...x"}, a string of JSON_CBOR_TEXT_MAX bytes, then one more
+	static uint8_t text[JSON_CBOR_TEXT_MAX + 16];
+	size_t n = 0;
+	text[n++] = 0xa1;					// map of 1
+	text[n++] = 0x61;					// text of 1
+	text[n++] = 's';
+	text[n++] = 0x79;					// text, 2-byte length
+	text[n++] = JSON_CBOR_TEXT_MAX >> 8;
+	text[n++] = JSON_CBOR_TEXT_MAX & 0xff;
+	memset(text + n, 'x', JSON_CBOR_TEXT_MAX);
+	n += JSON_CBOR_TEXT_MAX;
+	decoded = json_init(buffer2, sizeof(buffer2), 8);
+	CHECK((int)n == json_from_cbor(&decoded, text, n));
+	CHECK(JSON_CBOR_TEXT_MAX == strlen(json_get_str(&decoded, "s")));
+	text[4] = (JSON_CBOR_TEXT_MAX + 1) >> 8;
+	text[5] = (JSON_CBOR_TEXT_MAX + 1) & 0xff;
+	text[n++] = 'x';
+	decoded = json_init(buffer2, sizeof(buffer2), 8);
+	CHECK(JSON_ERROR == json_from_cbor(&decoded, text, n));
+
+	// a length past the end of the input
+	uint8_t huge[] = { 0xa1, 0x7b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 'k' };
+	CHECK(JSON_ERROR == json_from_cbor(&decoded, huge, sizeof(huge)));
+
+	// {"a": {"a": ... {}}}, nested one level deeper than allowed
+	static uint8_t deep[3 * JSON_INPUT_DEPTH + 1];
+	n = 0;
+	deep[n++] = 0xa1;
+	for (int d = 0; d < JSON_INPUT_DEPTH; d++)
+	{
+		deep[n++] = 0x61;
+		deep[n++] = 'a';
+		deep[n++] = 0xa1;
+	}
+	deep[n - 1] = 0xa0;					// the last map is empty
+	static char big[1 << 16];
+	decoded = json_init(big, sizeof(big), 4);
+	CHECK(JSON_ERROR == json_from_cbor(&decoded, deep, n));
+	// one level less is fine
+	deep[n - 4] = 0xa0;
+	decoded = json_init(big, sizeof(big), 4);
+	CHECK((int)n - 3 == json_from_cbor(&decoded, deep, n - 3));
+
+	printf("cbor_example: %d failures\n", failures);
+	return failures ? 1 : 0;
+}
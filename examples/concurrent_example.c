@@ -0,0 +1,85 @@
+#include "json.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Concurrent objects: once json_make_concurrent() is called, many threads
+ * change the numbers of an object and its children at once, without locks.
+ * Run by "make test".
+ */
+
+#define THREADS		4
+#define ROUNDS		100000
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static void *count(void *arg)
+{
+	json_t *obj = arg;
+	json_t stats = json_get_obj(obj, "stats");
+	for (int i = 0; i < ROUNDS; i++)
+	{
+		json_add_int(obj, "count", 1);
+		json_add_int(&stats, "hits", 2);
+		json_add_float(&stats, "load", 0.5f);
+	}
+	return NULL;
+}
+
+// Count from THREADS threads, and check the totals.
+static void count_all(json_t *obj)
+{
+	pthread_t threads[THREADS];
+	for (int t = 0; t < THREADS; t++)
+	{
+		pthread_create(&threads[t], NULL, count, obj);
+	}
+	for (int t = 0; t < THREADS; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	json_t stats = json_get_obj(obj, "stats");
+	CHECK(1 + THREADS * ROUNDS == json_get_int(obj, "count"));
+	CHECK(1 + 2 * THREADS * ROUNDS == json_get_int(&stats, "hits"));
+	CHECK(1.0f + 0.5f * THREADS * ROUNDS == json_get_float(&stats, "load"));
+}
+
+int main(void)
+{
+	char input[] = "{\"name\":\"counter\",\"count\":1,\"stats\":{\"id\":\"a\",\"hits\":1,\"load\":1.0}}";
+	static char buffer[1024];
+	json_t obj = json_init(buffer, sizeof(buffer), 4);
+	CHECK(json_parse(&obj, input) > 0);
+	CHECK(JSON_OK == json_make_concurrent(&obj));
+	CHECK(json_is_concurrent(&obj));
+	count_all(&obj);
+
+	// the layout is frozen: strings and keys cannot change
+	CHECK(JSON_OK != json_set_str(&obj, "name", "other"));
+	CHECK(JSON_OK != json_insert_int(&obj, "new", 1));
+	char str[160];
+	json_strncpy(str, &obj, sizeof(str));
+	CHECK(NULL != strstr(str, "\"count\":400001"));
+
+	// a compact copy has no room left, and needs none as its numbers are aligned
+	static char compact[1024];
+	char input2[] = "{\"name\":\"counter\",\"count\":1,\"stats\":{\"id\":\"a\",\"hits\":1,\"load\":1.0}}";
+	static char buffer2[1024];
+	json_t src = json_init(buffer2, sizeof(buffer2), 4);
+	CHECK(json_parse(&src, input2) > 0);
+	size_t size = json_compact_size(&src);
+	json_t copy = json_clone_compact(compact, size, &src);
+	CHECK(NULL != copy.buf);
+	if (NULL != copy.buf)
+	{
+		CHECK(JSON_OK == json_make_concurrent(&copy));
+		count_all(&copy);
+	}
+
+	printf("concurrent_example: %d failures\n", failures);
+	return failures ? 1 : 0;
+}
@@ -118,8 +118,8 @@ int main()
 	json_parse(&test2, str_input2);
 
 	char str_input3[] = "{\"message\":\"JSON Child Ojbect\",\"sensor3\":0.562}";
-	char buffer3[200];
-	json_t test3 = json_init(buffer3, 200, 2);  // 4 is table size, this MUST be power of 2.
+	char buffer3[256];
+	json_t test3 = json_init(buffer3, 256, 2);  // 4 is table size, this MUST be power of 2.
 	json_parse(&test3, str_input3);
 
 	json_insert_obj(&test2, "Child", &test3);
@@ -9,8 +9,8 @@ void json_example(void)
 	 */
 	char str_input[] = "{\"sensor1\":0.045600,\"message\":\"JSON Is Cool\",\"sensor2\":142}";
 
-	char buffer[256];
-	json_t test = json_init(buffer, 256, 4);  // 4 is table size, this MUST be power of 2.
+	char buffer[512];
+	json_t test = json_init(buffer, 512, 4);  // 4 is table size, this MUST be power of 2.
 	json_parse(&test, str_input);
 
 	float sensor1 = json_get_float(&test, "sensor1"); // 0.0456
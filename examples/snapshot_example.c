@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L	// mkstemp()
+
+#include "json.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Snapshot files: an object is written once, then mapped read-only and used
+ * without parsing. Damaged files are refused. Run by "make test".
+ */
+
+// The file starts with a header of this size, then the buffer.
+#define SNAPSHOT_FILE_HEADER	64
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// Write buf as the file at path.
+static void write_file(const char *path, const void *buf, size_t len)
+{
+	FILE *file = fopen(path, "wb");
+	fwrite(buf, 1, len, file);
+	fclose(file);
+}
+
+int main(void)
+{
+	char input[] = "{\"id\":7,\"name\":\"sensor\",\"pos\":{\"x\":1,\"y\":-2},\"temp\":21.5}";
+	static char buffer[1024];
+	json_t obj = json_init(buffer, sizeof(buffer), 8);
+	CHECK(json_parse(&obj, input) > 0);
+
+	char path[] = "/tmp/snapshot_example_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	CHECK(JSON_OK == json_snapshot_write(&obj, fd));
+	close(fd);
+
+	// mapped, and read as the object written
+	json_t mapped = json_snapshot_map(path);
+	CHECK(NULL != mapped.buf);
+	if (NULL != mapped.buf)
+	{
+		json_t pos = json_get_obj(&mapped, "pos");
+		CHECK(7 == json_get_int(&mapped, "id"));
+		CHECK(0 == strcmp("sensor", json_get_str(&mapped, "name")));
+		CHECK(21.5f == json_get_float(&mapped, "temp"));
+		CHECK(-2 == json_get_int(&pos, "y"));
+		// read-only, children too
+		CHECK(json_is_frozen(&mapped));
+		CHECK(JSON_FROZEN == json_set_int(&mapped, "id", 8));
+		CHECK(JSON_FROZEN == json_set_int(&pos, "x", 3));
+
+		char str[128];
+		json_strcpy(str, &obj);
+		char mapped_str[128];
+		json_strcpy(mapped_str, &mapped);
+		CHECK(0 == strcmp(str, mapped_str));
+		CHECK(JSON_OK == json_snapshot_unmap(&mapped));
+	}
+
+	// damaged copies are refused
+	FILE *file = fopen(path, "rb");
+	static unsigned char saved[2048];
+	size_t len = fread(saved, 1, sizeof(saved), file);
+	fclose(file);
+	json_t pos = json_get_obj(&obj, "pos");
+	size_t child = SNAPSHOT_FILE_HEADER + (size_t)((char *)pos.buf - (char *)obj.buf);
+
+	write_file(path, saved, len - 1);		// cut short
+	CHECK(NULL == json_snapshot_map(path).buf);
+
+	static unsigned char damaged[2048];
+	memcpy(damaged, saved, len);
+	size_t idx = 99;		// the index of the child in its parent
+	memcpy(damaged + child + offsetof(struct json_header_shape_, size[0]), &idx, sizeof(idx));
+	write_file(path, damaged, len);
+	CHECK(NULL == json_snapshot_map(path).buf);
+
+	memcpy(damaged, saved, len);
+	damaged[0] ^= 0xff;		// magic
+	write_file(path, damaged, len);
+	CHECK(NULL == json_snapshot_map(path).buf);
+
+	unlink(path);
+	printf("snapshot_example: %d failures\n", failures);
+	return failures ? 1 : 0;
+}